@@ -0,0 +1,108 @@
+#pragma once
+//
+//  alloc_check.hpp  –  Contagem de alocações do laço de I/O (build instrumentado)
+// Com -DSLOW_ALLOC_CHECK=1 (make alloccheck), este arquivo substitui os
+// operator new/delete globais por versões que contam as alocações feitas pela
+// thread que "armou" a contagem. O drive_session arma depois de SLOW_ALLOC_WARMUP
+// pacotes (o aquecimento enche o pool, a fila e os vetores reaproveitados) e,
+// ao sair, reprova a execução se o regime estacionário alocou qualquer coisa.
+// Fora desse build, arm/disarm/report não fazem nada e nada é substituído.
+//
+// As substituições são definições globais: inclua este arquivo em um único
+// .cpp (o peripheral.cpp).
+#include <cstddef> // Para std::size_t.
+#include <cstdint> // Para tipos inteiros de largura fixa.
+#include <cstdio>  // Para imprimir o resultado.
+#include <cstdlib> // Para malloc e free.
+#include <new>     // Para std::bad_alloc e std::align_val_t.
+
+#ifndef SLOW_ALLOC_CHECK
+#define SLOW_ALLOC_CHECK 0
+#endif
+#ifndef SLOW_ALLOC_WARMUP
+#define SLOW_ALLOC_WARMUP 64 // Pacotes (enviados + recebidos) antes de armar.
+#endif
+
+namespace slow::alloc_check {
+
+inline constexpr bool     ENABLED = SLOW_ALLOC_CHECK != 0;
+inline constexpr uint64_t WARMUP  = SLOW_ALLOC_WARMUP;
+
+// Estado da thread armada (só o laço de I/O arma; as threads de fundo não contam).
+struct Counter {
+    bool      armed = false;
+    uint64_t  count = 0, bytes = 0;
+    std::size_t first_size = 0;     // Primeira alocação no regime estacionário...
+    void*       first_caller = nullptr; // ...e quem a fez (use com addr2line).
+};
+inline thread_local Counter counter;
+inline bool failed = false;
+
+inline void arm()    { if constexpr (ENABLED) { counter = Counter{}; counter.armed = true; } }
+inline void disarm() { if constexpr (ENABLED) counter.armed = false; }
+inline bool armed()  { return ENABLED && counter.armed; }
+
+// Desarma e imprime o resultado. Retorna false (e marca `failed`) se houve
+// alocação com a contagem armada.
+inline bool report() {
+    if constexpr (!ENABLED) return true;
+    bool was_armed = counter.armed;
+    disarm();
+    if (!was_armed) {
+        std::printf("[alloc-check] não armou: menos de %llu pacotes\n",
+                    static_cast<unsigned long long>(WARMUP));
+        return true;
+    }
+    if (counter.count == 0) {
+        std::printf("[alloc-check] OK: nenhuma alocação no regime estacionário\n");
+        return true;
+    }
+    std::printf("[alloc-check] FALHOU: %llu alocações (%llu B) no regime estacionário;"
+                " a primeira, de %zu B, veio de %p\n",
+                static_cast<unsigned long long>(counter.count),
+                static_cast<unsigned long long>(counter.bytes), counter.first_size,
+                counter.first_caller);
+    failed = true;
+    return false;
+}
+
+inline void note(std::size_t n, void* caller) {
+    Counter& c = counter;
+    if (!c.armed) return;
+    if (c.count++ == 0) { c.first_size = n; c.first_caller = caller; }
+    c.bytes += n;
+}
+
+} // namespace slow::alloc_check
+
+#if SLOW_ALLOC_CHECK
+// ───────────────────────── operator new/delete ─────────────────────────
+// Só as formas básicas e as alinhadas; as nothrow e de array delegam a elas
+// nas implementações usuais da biblioteca padrão. O GCC não sabe que o
+// operator new abaixo usa malloc e acusaria o free dos deletes.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+void* operator new(std::size_t n) {
+    slow::alloc_check::note(n, __builtin_return_address(0));
+    if (void* p = std::malloc(n ? n : 1)) return p;
+    throw std::bad_alloc();
+}
+void* operator new[](std::size_t n) {
+    slow::alloc_check::note(n, __builtin_return_address(0));
+    if (void* p = std::malloc(n ? n : 1)) return p;
+    throw std::bad_alloc();
+}
+void* operator new(std::size_t n, std::align_val_t a) {
+    slow::alloc_check::note(n, __builtin_return_address(0));
+    std::size_t al = static_cast<std::size_t>(a);
+    if (void* p = std::aligned_alloc(al, (n + al - 1) / al * al)) return p;
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept                              { std::free(p); }
+void operator delete[](void* p) noexcept                            { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept                 { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept               { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept            { std::free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+#pragma GCC diagnostic pop
+#endif
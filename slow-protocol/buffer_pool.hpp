@@ -0,0 +1,134 @@
+#pragma once
+//
+//  buffer_pool.hpp  –  Pool de buffers de tamanho fixo (MTU) do SLOW
+// Este arquivo define um pool de buffers de 1472 bytes (cabeçalho + payload
+// máximo) servidos a partir de arenas grandes, opcionalmente em huge pages
+// de 2 MB. Imagens de TX, datagramas recebidos e fragmentos em remontagem
+// usam esses buffers, de modo que o regime estacionário não chama o alocador.
+#include <cstddef>    // Para std::size_t.
+#include <cstdint>    // Para uint8_t, uint16_t.
+#include <stdexcept>  // Para std::runtime_error em falhas de mmap.
+#include <sys/mman.h> // Para mmap/munmap/madvise.
+#include <utility>    // Para std::exchange.
+#include <vector>     // Para a lista de arenas.
+
+namespace slow {
+
+// Tamanho de cada buffer: cabeçalho (32 B) + payload máximo (1440 B).
+// 1472 é múltiplo de 64, então todos os buffers ficam alinhados à linha de cache.
+constexpr size_t MTU_BUF = 1472;
+
+// ───────────────────────── BufferPool ─────────────────────────
+// Pool de buffers MTU com lista livre intrusiva. Cada arena tem 2 MB e é
+// mapeada com MAP_HUGETLB quando possível; se o sistema não tiver huge pages
+// reservadas, cai para um mapeamento comum com MADV_HUGEPAGE (THP).
+// Não é thread-safe: pertence ao laço de I/O da sessão.
+class BufferPool {
+public:
+    static constexpr size_t ARENA_BYTES = 2u << 20; // 2 MB
+    static constexpr size_t PER_ARENA   = ARENA_BYTES / MTU_BUF;
+
+    explicit BufferPool(bool huge_pages = true) : huge_(huge_pages) {}
+    ~BufferPool() {
+        for (auto& a : arenas_) munmap(a.base, a.bytes);
+    }
+    BufferPool(const BufferPool&)            = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    // Retira um buffer da lista livre (cresce em uma arena se estiver vazia).
+    uint8_t* acquire() {
+        if (!free_) grow();
+        Node* n = free_;
+        free_ = n->next;
+        ++in_use_;
+        return reinterpret_cast<uint8_t*>(n);
+    }
+    // Devolve um buffer à lista livre.
+    void release(uint8_t* p) {
+        Node* n = reinterpret_cast<Node*>(p);
+        n->next = free_;
+        free_ = n;
+        --in_use_;
+    }
+
+    size_t in_use()   const { return in_use_; }
+    size_t capacity() const { return arenas_.size() * PER_ARENA; }
+
+private:
+    struct Node  { Node* next; };
+    struct Arena { void* base; size_t bytes; };
+
+    // Mapeia uma nova arena e encadeia todos os seus buffers na lista livre.
+    void grow() {
+        void* base = MAP_FAILED;
+#ifdef MAP_HUGETLB
+        if (huge_)
+            base = mmap(nullptr, ARENA_BYTES, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+        if (base == MAP_FAILED) {
+            base = mmap(nullptr, ARENA_BYTES, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (base == MAP_FAILED) throw std::runtime_error("mmap da arena falhou");
+#ifdef MADV_HUGEPAGE
+            if (huge_) madvise(base, ARENA_BYTES, MADV_HUGEPAGE);
+#endif
+        }
+        arenas_.push_back({base, ARENA_BYTES});
+        uint8_t* p = static_cast<uint8_t*>(base);
+        for (size_t i = PER_ARENA; i-- > 0;) {
+            Node* n = reinterpret_cast<Node*>(p + i * MTU_BUF);
+            n->next = free_;
+            free_ = n;
+        }
+    }
+
+    bool   huge_;
+    Node*  free_   = nullptr;
+    size_t in_use_ = 0;
+    std::vector<Arena> arenas_;
+};
+
+// ───────────────────────── PacketBuf ─────────────────────────
+// Handle RAII (somente movível) para um buffer do pool, com o número de
+// bytes válidos. Devolve o buffer ao pool ao ser destruído.
+class PacketBuf {
+public:
+    PacketBuf() = default;
+    explicit PacketBuf(BufferPool& pool) : pool_(&pool), p_(pool.acquire()) {}
+    ~PacketBuf() { reset(); }
+
+    PacketBuf(PacketBuf&& o) noexcept
+        : pool_(std::exchange(o.pool_, nullptr)),
+          p_(std::exchange(o.p_, nullptr)),
+          len_(std::exchange(o.len_, 0)) {}
+    PacketBuf& operator=(PacketBuf&& o) noexcept {
+        if (this != &o) {
+            reset();
+            pool_ = std::exchange(o.pool_, nullptr);
+            p_    = std::exchange(o.p_, nullptr);
+            len_  = std::exchange(o.len_, 0);
+        }
+        return *this;
+    }
+    PacketBuf(const PacketBuf&)            = delete;
+    PacketBuf& operator=(const PacketBuf&) = delete;
+
+    uint8_t*       data()       { return p_; }
+    const uint8_t* data() const { return p_; }
+    size_t   size()     const { return len_; }
+    void     resize(size_t n) { len_ = static_cast<uint16_t>(n); }
+    explicit operator bool() const { return p_ != nullptr; }
+
+    void reset() {
+        if (p_) pool_->release(p_);
+        p_ = nullptr; len_ = 0;
+    }
+
+private:
+    BufferPool* pool_ = nullptr;
+    uint8_t*    p_    = nullptr;
+    uint16_t    len_  = 0;
+};
+
+} // namespace slow
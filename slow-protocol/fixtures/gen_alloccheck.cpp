@@ -0,0 +1,86 @@
+//
+//  gen_alloccheck.cpp – gerador de fixtures/alloccheck.pcap (make fixtures)
+//
+
+// Este arquivo implementa o gerador da captura usada por `make alloccheck`.
+// A captura só tem o lado do central (é o que o --replay lê): o SETUP, uma
+// mensagem de 20000 bytes enviada por ele e um ACK para cada fragmento da
+// mensagem do periférico, até o ACK do DISCONNECT. Os ACKs descontam o sttl
+// a cada pacote, como um central de verdade, para que o laço refaça o
+// template de cabeçalho depois do aquecimento; alguns ACKs duplicados no
+// meio passam pela contagem de ACKs duplicados.
+
+#include "../pcap.hpp"         // Inclui o PcapWriter.
+#include "../slow_packet.hpp"  // Inclui Packet e as flags.
+#include <arpa/inet.h>         // Para htons e inet_addr.
+#include <cstdlib>             // Para std::strtoul.
+#include <iostream>            // Para entrada/saída padrão.
+
+using namespace slow;
+
+constexpr uint32_t CENTRAL_SEQ = 100;   // seqnum do SETUP: o periférico começa em 101.
+constexpr uint32_t STTL        = 30000;
+constexpr size_t   CENTRAL_MSG = 20000; // Mensagem enviada pelo central.
+constexpr uint8_t  CENTRAL_FID = 7;
+constexpr uint32_t DUP_AT      = 45;    // ACKs duplicados depois do 45º fragmento,
+constexpr int      DUP_ACKS    = 7;     // quantos.
+
+int main(int argc, char* argv[]) {
+    if (argc != 3) { std::cerr << "uso: ./gen_alloccheck BYTES_DA_MENSAGEM ARQUIVO.pcap\n"; return 1; }
+    size_t   msg_bytes = std::strtoul(argv[1], nullptr, 10);
+    uint32_t frags     = static_cast<uint32_t>((msg_bytes + Payload::CAPACITY - 1) / Payload::CAPACITY);
+
+    sockaddr_in local{}, remote{};
+    local.sin_family       = remote.sin_family = AF_INET;
+    local.sin_addr.s_addr  = remote.sin_addr.s_addr = inet_addr("127.0.0.1");
+    local.sin_port         = htons(34763);
+    remote.sin_port        = htons(7033);
+    PcapWriter out;
+    if (!out.open(argv[2], local, remote)) { std::perror(argv[2]); return 1; }
+
+    Packet p{};
+    auto emit = [&] {
+        auto raw = p.serialize();
+        out.write(false, raw.data(), raw.size());
+        p.data.clear();
+    };
+
+    // SETUP (ACCEPT), sem opções.
+    p.sttl   = STTL;
+    p.flags  = FLAG_ACCEPT;
+    p.seqnum = CENTRAL_SEQ;
+    p.window = 65535;
+    emit();
+
+    // Mensagem do central em fragmentos de 1440 B.
+    std::vector<uint8_t> msg(CENTRAL_MSG);
+    for (size_t i = 0; i < msg.size(); ++i) msg[i] = static_cast<uint8_t>('A' + i % 26);
+    uint32_t n = static_cast<uint32_t>((msg.size() + Payload::CAPACITY - 1) / Payload::CAPACITY);
+    for (uint32_t i = 0; i < n; ++i) {
+        size_t from = i * Payload::CAPACITY;
+        size_t to   = std::min(msg.size(), from + Payload::CAPACITY);
+        p.flags  = FLAG_ACK | (i + 1 < n ? FLAG_MOREBITS : 0);
+        p.seqnum = CENTRAL_SEQ + 1 + i;
+        p.acknum = 0;
+        p.fid    = CENTRAL_FID;
+        p.fo     = static_cast<uint8_t>(i);
+        p.data.assign(msg.data() + from, msg.data() + to);
+        emit();
+    }
+
+    // Um ACK por fragmento do periférico, cada um com um sttl menor.
+    p.fid = p.fo = 0;
+    p.flags = FLAG_ACK;
+    for (uint32_t i = 1; i <= frags; ++i) {
+        p.seqnum = p.acknum = CENTRAL_SEQ + i;
+        p.sttl   = STTL - i;
+        emit();
+        if (i == DUP_AT)
+            for (int d = 0; d < DUP_ACKS; ++d) emit();
+    }
+    // ACK do DISCONNECT (seqnum seguinte ao último fragmento).
+    p.seqnum = p.acknum = CENTRAL_SEQ + frags + 1;
+    p.window = 0;
+    emit();
+    return 0;
+}
@@ -0,0 +1,84 @@
+#pragma once
+//
+//  histogram.hpp  –  Histograma de latências com buckets logarítmicos (estilo HDR)
+// Este arquivo define o LatencyHistogram, usado pela sessão para guardar a
+// distribuição do RTT e da latência de mensagens (enfileirada → confirmada).
+// Os buckets são log-lineares: cada potência de 2 é dividida em 32 partes,
+// então o erro relativo de qualquer percentil fica abaixo de ~3%.
+// Gravar é só um fetch_add relaxado: sem locks e sem alocação.
+#include <algorithm> // Para std::min.
+#include <array>   // Para o vetor fixo de contadores.
+#include <atomic>  // Para os contadores lock-free.
+#include <bit>     // Para std::bit_width.
+#include <cstdint> // Para tipos inteiros de largura fixa.
+#include <ostream> // Para imprimir os percentis.
+
+namespace slow {
+
+class LatencyHistogram {
+public:
+    static constexpr unsigned SUB_BITS = 5;               // 32 sub-buckets por potência de 2.
+    static constexpr uint64_t SUB      = 1u << SUB_BITS;
+    static constexpr unsigned MAX_EXP  = 40;              // Valores até 2^40 µs (~12 dias).
+    static constexpr size_t   BUCKETS  = (MAX_EXP - SUB_BITS + 2) * SUB;
+
+    // Registra um valor (em µs). Valores acima do alcance caem no último bucket.
+    void record(uint64_t v) {
+        counts_[index(v)].fetch_add(1, std::memory_order_relaxed);
+        total_.fetch_add(1, std::memory_order_relaxed);
+        uint64_t m = max_.load(std::memory_order_relaxed);
+        while (v > m && !max_.compare_exchange_weak(m, v, std::memory_order_relaxed)) {}
+    }
+
+    uint64_t count() const { return total_.load(std::memory_order_relaxed); }
+    uint64_t max()   const { return max_.load(std::memory_order_relaxed); }
+
+    // Menor valor v (limite superior do bucket) tal que ao menos a fração `q`
+    // das amostras é ≤ v. Retorna 0 se não há amostras.
+    uint64_t percentile(double q) const {
+        uint64_t n = count();
+        if (n == 0) return 0;
+        uint64_t rank = static_cast<uint64_t>(q * static_cast<double>(n) + 0.5);
+        if (rank < 1) rank = 1;
+        if (rank > n) rank = n;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < BUCKETS; ++i) {
+            seen += counts_[i].load(std::memory_order_relaxed);
+            if (seen >= rank) return std::min(upper(i), max());
+        }
+        return max();
+    }
+
+private:
+    // Abaixo de SUB o bucket é o próprio valor; acima, o expoente escolhe a
+    // faixa e os SUB_BITS bits seguintes ao mais significativo, o sub-bucket.
+    static size_t index(uint64_t v) {
+        if (v < SUB) return static_cast<size_t>(v);
+        unsigned e = static_cast<unsigned>(std::bit_width(v)) - 1;
+        if (e > MAX_EXP) return BUCKETS - 1;
+        return (e - SUB_BITS + 1) * SUB + static_cast<size_t>((v >> (e - SUB_BITS)) - SUB);
+    }
+    // Maior valor que cai no bucket `i`.
+    static uint64_t upper(size_t i) {
+        if (i < SUB) return i;
+        unsigned e   = static_cast<unsigned>(i / SUB) + SUB_BITS - 1;
+        uint64_t sub = i % SUB + SUB;
+        return ((sub + 1) << (e - SUB_BITS)) - 1;
+    }
+
+    std::array<std::atomic<uint64_t>, BUCKETS> counts_{};
+    std::atomic<uint64_t> total_{0};
+    std::atomic<uint64_t> max_{0};
+};
+
+// Imprime "n=…  p50=…  p99=…  p99.9=…  max=…" em ms.
+inline std::ostream& operator<<(std::ostream& os, const LatencyHistogram& h) {
+    if (h.count() == 0) return os << "sem amostras";
+    return os << "n=" << h.count()
+              << "  p50="   << h.percentile(0.50)  / 1000.0
+              << "  p99="   << h.percentile(0.99)  / 1000.0
+              << "  p99.9=" << h.percentile(0.999) / 1000.0
+              << "  max="   << h.max() / 1000.0 << " ms";
+}
+
+} // namespace slow
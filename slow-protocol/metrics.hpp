@@ -0,0 +1,222 @@
+#pragma once
+//
+//  metrics.hpp  –  Exportador de métricas do SLOW no formato texto do Prometheus
+// Este arquivo define o MetricsExporter: o laço de I/O publica periodicamente
+// um MetricsSnapshot num buffer triplo lock-free e uma thread de fundo serve
+// o snapshot mais recente em HTTP (porta TCP local ou socket Unix). A leitura
+// nunca bloqueia nem atrasa o laço de I/O. Também define o LoopTimer, que
+// mede o tempo ocupado de cada iteração do laço (sem a espera no poll).
+#include "session.hpp"  // Para SessionStats.
+#include <array>        // Para o buffer triplo.
+#include <atomic>       // Para a troca de buffers e o sinal de parada.
+#include <chrono>       // Para os tempos do laço e o uptime.
+#include <cstdint>      // Para tipos inteiros de largura fixa.
+#include <cstdio>       // Para snprintf.
+#include <cstdlib>      // Para std::atoi.
+#include <cstring>      // Para std::strchr e std::strncpy.
+#include <poll.h>       // Para poll no socket de escuta.
+#include <string>       // Para montar a resposta.
+#include <sys/socket.h> // Para socket, bind, listen e accept.
+#include <sys/un.h>     // Para sockaddr_un.
+#include <netinet/in.h> // Para sockaddr_in.
+#include <thread>       // Para a thread do servidor.
+#include <unistd.h>     // Para close e unlink.
+
+namespace slow {
+
+// ───────────────────────── LoopTimer ─────────────────────────
+// Tempo ocupado por iteração: do topo do laço até a espera por datagramas e
+// do retorno da espera até o topo seguinte. A iteração só é contabilizada
+// quando a próxima começa.
+class LoopTimer {
+public:
+    using clock = std::chrono::steady_clock;
+
+    void begin(clock::time_point now) {
+        if (started_) {
+            uint64_t ns = static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    (pause_ - begin_) + (now - resume_)).count());
+            ++iters_;
+            busy_ns_ += ns;
+            if (ns > max_ns_) max_ns_ = ns;
+        }
+        begin_ = pause_ = resume_ = now;
+        started_ = true;
+    }
+    void pause(clock::time_point now)  { pause_  = now; }
+    void resume(clock::time_point now) { resume_ = now; }
+
+    uint64_t iterations() const { return iters_; }
+    uint64_t busy_ns()    const { return busy_ns_; }
+    // Maior iteração desde a última chamada (zera a janela).
+    uint64_t take_max_ns() { uint64_t m = max_ns_; max_ns_ = 0; return m; }
+
+private:
+    clock::time_point begin_{}, pause_{}, resume_{};
+    bool     started_ = false;
+    uint64_t iters_ = 0, busy_ns_ = 0, max_ns_ = 0;
+};
+
+// ───────────────────────── MetricsSnapshot ─────────────────────────
+struct MetricsSnapshot {
+    SessionStats stats;
+    uint64_t uptime_us     = 0;
+    double   packets_per_s = 0;  // Enviados + recebidos, na última janela de ~1 s.
+    uint64_t reasm_bytes   = 0;  // Buffers retidos pela remontagem (fragmentos e paridades).
+    uint64_t pool_bytes    = 0;  // Buffers do pool em uso (TX, RX e remontagem).
+    uint64_t loop_iters    = 0;
+    uint64_t loop_busy_ns  = 0;
+    uint64_t loop_max_ns   = 0;  // Maior iteração na janela de publicação.
+};
+
+// Acrescenta o snapshot a `out` no formato texto do Prometheus (versão 0.0.4).
+inline void write_prometheus(std::string& out, const MetricsSnapshot& m) {
+    char line[512];
+    auto metric = [&](const char* name, const char* type, const char* help, double v) {
+        std::snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s %s\n%s %.12g\n",
+                      name, help, name, type, name, v);
+        out += line;
+    };
+    const SessionStats& s = m.stats;
+    double sent = static_cast<double>(s.packets_sent);
+    metric("slow_uptime_seconds", "gauge", "Tempo desde o inicio do processo.", m.uptime_us / 1e6);
+    metric("slow_packets_sent_total", "counter", "Datagramas enviados.", sent);
+    metric("slow_bytes_sent_total", "counter", "Bytes enviados.", static_cast<double>(s.bytes_sent));
+    metric("slow_packets_received_total", "counter", "Datagramas recebidos.", static_cast<double>(s.packets_rcvd));
+    metric("slow_bytes_received_total", "counter", "Bytes recebidos.", static_cast<double>(s.bytes_rcvd));
+    metric("slow_rx_malformed_total", "counter", "Datagramas de dados curtos demais, descartados.",
+           static_cast<double>(s.rx_malformed));
+    metric("slow_packets_per_second", "gauge", "Datagramas enviados e recebidos por segundo.", m.packets_per_s);
+    metric("slow_retransmits_total", "counter", "Datagramas retransmitidos.", static_cast<double>(s.packets_retx));
+    metric("slow_retransmit_ratio", "gauge", "Retransmitidos sobre enviados.",
+           sent > 0 ? static_cast<double>(s.packets_retx) / sent : 0.0);
+    metric("slow_rto_fires_total", "counter", "Retransmissoes por timeout.", static_cast<double>(s.rto_fires));
+    metric("slow_tail_probes_total", "counter", "Tail loss probes.", static_cast<double>(s.tail_probes));
+    metric("slow_dup_acks_total", "counter", "ACKs duplicados.", static_cast<double>(s.dup_acks));
+    metric("slow_window_stall_seconds_total", "counter", "Tempo barrado pela janela remota.",
+           s.window_stall_us / 1e6);
+    metric("slow_in_flight_bytes", "gauge", "Payload enviado e nao confirmado.", static_cast<double>(s.in_flight));
+    metric("slow_srtt_seconds", "gauge", "RTT suavizado (-1 sem amostra).",
+           s.srtt_us < 0 ? -1.0 : s.srtt_us / 1e6);
+    metric("slow_reassembly_bytes", "gauge", "Memoria retida pela remontagem.", static_cast<double>(m.reasm_bytes));
+    metric("slow_pool_bytes", "gauge", "Memoria do pool de buffers em uso.", static_cast<double>(m.pool_bytes));
+    metric("slow_messages_reassembled_total", "counter", "Mensagens remontadas.",
+           static_cast<double>(s.msgs_reassembled));
+    metric("slow_fec_recovered_total", "counter", "Fragmentos recuperados por FEC.",
+           static_cast<double>(s.fec_recovered));
+    metric("slow_loop_iterations_total", "counter", "Iteracoes do laco de I/O.", static_cast<double>(m.loop_iters));
+    metric("slow_loop_busy_seconds_total", "counter", "Tempo ocupado do laco de I/O (sem a espera).",
+           m.loop_busy_ns / 1e9);
+    metric("slow_loop_iteration_max_seconds", "gauge", "Maior iteracao do laco na ultima janela.",
+           m.loop_max_ns / 1e9);
+}
+
+// ───────────────────────── MetricsExporter ─────────────────────────
+// Buffer triplo: o laço de I/O escreve sempre no seu buffer de trás e o troca
+// atomicamente com o do meio; o servidor troca o do meio com o da frente só
+// quando há um novo. Nenhum dos lados espera o outro.
+class MetricsExporter {
+public:
+    MetricsExporter() = default;
+    ~MetricsExporter() { close(); }
+    MetricsExporter(const MetricsExporter&)            = delete;
+    MetricsExporter& operator=(const MetricsExporter&) = delete;
+
+    // `spec` com '/' é o caminho de um socket Unix; senão, a porta TCP em
+    // 127.0.0.1. Retorna false se não conseguiu escutar.
+    bool open(const char* spec) {
+        close();
+        if (std::strchr(spec, '/')) {
+            sockaddr_un a{};
+            a.sun_family = AF_UNIX;
+            std::strncpy(a.sun_path, spec, sizeof(a.sun_path) - 1);
+            unlink(a.sun_path);
+            fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+            if (fd_ < 0 || bind(fd_, reinterpret_cast<sockaddr*>(&a), sizeof(a)) < 0) return fail();
+            unix_path_ = a.sun_path;
+        } else {
+            int port = std::atoi(spec);
+            if (port <= 0 || port > 65535) return false;
+            sockaddr_in a{};
+            a.sin_family      = AF_INET;
+            a.sin_port        = htons(static_cast<uint16_t>(port));
+            a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            fd_ = socket(AF_INET, SOCK_STREAM, 0);
+            int one = 1;
+            if (fd_ >= 0) setsockopt(fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            if (fd_ < 0 || bind(fd_, reinterpret_cast<sockaddr*>(&a), sizeof(a)) < 0) return fail();
+        }
+        if (listen(fd_, 8) < 0) return fail();
+        t0_ = std::chrono::steady_clock::now();
+        stop_.store(false, std::memory_order_relaxed);
+        server_ = std::thread([this] { serve_loop(); });
+        return true;
+    }
+    void close() {
+        if (fd_ < 0) return;
+        stop_.store(true, std::memory_order_release);
+        if (server_.joinable()) server_.join();
+        ::close(fd_);
+        fd_ = -1;
+        if (!unix_path_.empty()) unlink(unix_path_.c_str());
+        unix_path_.clear();
+    }
+    bool active() const { return fd_ >= 0; }
+
+    // Produtor (laço de I/O): publica um snapshot. Só copia e troca um índice.
+    void publish(const MetricsSnapshot& m) {
+        buf_[back_] = m;
+        buf_[back_].uptime_us = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - t0_).count());
+        back_ = middle_.exchange(static_cast<uint8_t>(back_ | FRESH), std::memory_order_acq_rel) & INDEX;
+    }
+
+private:
+    static constexpr uint8_t FRESH = 4, INDEX = 3;
+
+    bool fail() {
+        if (fd_ >= 0) ::close(fd_);
+        fd_ = -1;
+        return false;
+    }
+    // Consumidor: o snapshot publicado mais recente.
+    const MetricsSnapshot& latest() {
+        if (middle_.load(std::memory_order_relaxed) & FRESH)
+            front_ = middle_.exchange(front_, std::memory_order_acq_rel) & INDEX;
+        return buf_[front_];
+    }
+    // Atende uma conexão por vez: lê o pedido (qualquer caminho) e responde
+    // com o snapshot. Acorda a cada 200 ms para ver o sinal de parada.
+    void serve_loop() {
+        std::string body, resp;
+        while (!stop_.load(std::memory_order_acquire)) {
+            pollfd p{fd_, POLLIN, 0};
+            if (poll(&p, 1, 200) <= 0) continue;
+            int c = accept(fd_, nullptr, nullptr);
+            if (c < 0) continue;
+            timeval tv{0, 200000};
+            setsockopt(c, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+            char req[1024];
+            (void)::recv(c, req, sizeof(req), 0);
+            body.clear();
+            write_prometheus(body, latest());
+            resp = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " +
+                   std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+            (void)::send(c, resp.data(), resp.size(), MSG_NOSIGNAL);
+            ::close(c);
+        }
+    }
+
+    std::array<MetricsSnapshot, 3> buf_{};
+    uint8_t back_  = 0;                 // Só o produtor usa.
+    uint8_t front_ = 2;                 // Só o servidor usa.
+    alignas(64) std::atomic<uint8_t> middle_{1};
+    std::atomic<bool> stop_{false};
+    int         fd_ = -1;
+    std::string unix_path_;
+    std::chrono::steady_clock::time_point t0_{};
+    std::thread server_;
+};
+
+} // namespace slow
@@ -0,0 +1,146 @@
+#pragma once
+//
+//  msg_trace.hpp  –  Ciclo de vida de cada mensagem do SLOW (Chrome trace)
+// Este arquivo define o MsgTrace: a sessão avisa quando uma mensagem é
+// enfileirada (queue_data), quando seus fragmentos saem (e quando são
+// retransmitidos), quando o ACK cobre o último fragmento e quando a janela
+// remota trava o envio. Ao fechar, tudo é exportado como JSON no formato de
+// eventos do Chrome (chrome://tracing, Perfetto): cada mensagem vira uma
+// faixa com as fases "fila", "envio" e "aguardando ACK".
+#include "slow_packet.hpp" // Para seq_le.
+#include <chrono>          // Para os instantes dos eventos.
+#include <cstdint>         // Para tipos inteiros de largura fixa.
+#include <cstdio>          // Para FILE*, fopen e fprintf.
+#include <vector>          // Para os eventos guardados até a exportação.
+
+namespace slow {
+
+class MsgTrace {
+public:
+    using clock = std::chrono::steady_clock;
+
+    MsgTrace() = default;
+    ~MsgTrace() { close(); }
+    MsgTrace(const MsgTrace&)            = delete;
+    MsgTrace& operator=(const MsgTrace&) = delete;
+
+    // Abre o arquivo já (para falhar cedo); o JSON só é escrito em close().
+    bool open(const char* path) {
+        close();
+        f_ = std::fopen(path, "w");
+        if (!f_) return false;
+        t0_ = clock::now();
+        msgs_.clear(); retx_.clear(); stalls_.clear();
+        msgs_.reserve(256);
+        open_ = 0;
+        return true;
+    }
+    // Exporta os eventos e fecha o arquivo.
+    void close() {
+        if (!f_) return;
+        write_json(us(clock::now()));
+        std::fclose(f_);
+        f_ = nullptr;
+    }
+    bool active() const { return f_ != nullptr; }
+
+    /*──── eventos (chamados pela sessão) ────*/
+    // Mensagem enfileirada com os fragmentos [first_seq, last_seq].
+    void queued(uint32_t first_seq, uint32_t last_seq, uint8_t fid, size_t bytes, clock::time_point now) {
+        msgs_.push_back({first_seq, last_seq, fid, static_cast<uint32_t>(bytes), us(now)});
+    }
+    // Um fragmento saiu; `retx` se já tinha saído antes, `tlp` se foi um tail loss probe.
+    void sent(uint32_t seq, bool retx, bool tlp, clock::time_point now) {
+        for (size_t i = open_; i < msgs_.size(); ++i) {
+            Msg& m = msgs_[i];
+            if (!seq_le(m.first_seq, seq) || !seq_le(seq, m.last_seq)) continue;
+            int64_t t = us(now);
+            if (retx) {
+                retx_.push_back({i, seq, tlp, t});
+                ++m.retx;
+            } else {
+                if (m.first_tx < 0) m.first_tx = t;
+                if (seq == m.last_seq) m.last_tx = t;
+            }
+            return;
+        }
+    }
+    // ACK cumulativo: fecha as mensagens cujo último fragmento foi confirmado.
+    void acked(uint32_t acknum, clock::time_point now) {
+        for (; open_ < msgs_.size() && seq_le(msgs_[open_].last_seq, acknum); ++open_)
+            msgs_[open_].acked = us(now);
+    }
+    // Intervalo em que havia dados na fila barrados pela janela remota.
+    void stall(clock::time_point from, clock::time_point to) {
+        stalls_.push_back({us(from), us(to)});
+    }
+
+private:
+    struct Msg {
+        uint32_t first_seq, last_seq;
+        uint8_t  fid;
+        uint32_t bytes;
+        int64_t  queued;
+        int64_t  first_tx = -1, last_tx = -1, acked = -1; // µs; -1 = não aconteceu.
+        uint32_t retx = 0;
+    };
+    struct Retx  { size_t msg; uint32_t seq; bool tlp; int64_t t; };
+    struct Stall { int64_t from, to; };
+
+    int64_t us(clock::time_point t) const {
+        return std::chrono::duration_cast<std::chrono::microseconds>(t - t0_).count();
+    }
+
+    // Faixa 0 = janela remota; faixa i+1 = mensagem i. Fases sem fim (mensagem
+    // não confirmada ao fechar) terminam em `end`.
+    void write_json(int64_t end) {
+        const char* sep = "";
+        auto span = [&](const char* name, unsigned tid, int64_t from, int64_t to) {
+            if (from < 0) return;
+            std::fprintf(f_, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%lld,\"dur\":%lld}",
+                         sep, name, tid, static_cast<long long>(from),
+                         static_cast<long long>((to < 0 ? end : to) - from));
+            sep = ",";
+        };
+        std::fprintf(f_, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+        std::fprintf(f_, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,"
+                         "\"args\":{\"name\":\"janela remota\"}}", sep);
+        sep = ",";
+        for (const Stall& s : stalls_) span("janela travada", 0, s.from, s.to);
+
+        for (size_t i = 0; i < msgs_.size(); ++i) {
+            const Msg& m = msgs_[i];
+            unsigned tid = static_cast<unsigned>(i + 1);
+            std::fprintf(f_, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+                             "\"args\":{\"name\":\"msg %zu (fid %u)\"}}", tid, i, unsigned{m.fid});
+            std::fprintf(f_, ",\n{\"name\":\"msg %zu\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%lld,\"dur\":%lld,"
+                             "\"args\":{\"fid\":%u,\"frags\":%u,\"bytes\":%u,\"first_seq\":%u,"
+                             "\"last_seq\":%u,\"retx\":%u,\"acked\":%s}}",
+                         i, tid, static_cast<long long>(m.queued),
+                         static_cast<long long>((m.acked < 0 ? end : m.acked) - m.queued),
+                         unsigned{m.fid}, m.last_seq - m.first_seq + 1, m.bytes, m.first_seq,
+                         m.last_seq, m.retx, m.acked < 0 ? "false" : "true");
+            // Fila: até o primeiro fragmento sair (janela ou ritmo de envio).
+            span("fila", tid, m.queued, m.first_tx < 0 ? m.acked : m.first_tx);
+            // Envio: do primeiro ao último fragmento (travas de janela no meio).
+            span("envio", tid, m.first_tx, m.last_tx);
+            // Aguardando ACK: perdas e retransmissões aparecem aqui.
+            span("aguardando ACK", tid, m.last_tx, m.acked);
+        }
+        for (const Retx& r : retx_)
+            std::fprintf(f_, ",\n{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":%u,"
+                             "\"ts\":%lld,\"args\":{\"seq\":%u}}",
+                         r.tlp ? "TLP" : "retx", static_cast<unsigned>(r.msg + 1),
+                         static_cast<long long>(r.t), r.seq);
+        std::fprintf(f_, "\n]}\n");
+    }
+
+    std::FILE* f_ = nullptr;
+    clock::time_point t0_{};
+    std::vector<Msg>   msgs_;    // Em ordem de enfileiramento (e de seqnum).
+    std::vector<Retx>  retx_;
+    std::vector<Stall> stalls_;
+    size_t open_ = 0;            // Primeira mensagem ainda não confirmada.
+};
+
+} // namespace slow
@@ -0,0 +1,149 @@
+#pragma once
+//
+//  pcap.hpp  –  Captura dos datagramas SLOW em formato pcap
+// Este arquivo define o PcapWriter, que grava cada datagrama enviado ou
+// recebido num arquivo pcap clássico (LINKTYPE_RAW) com cabeçalhos IPv4/UDP
+// sintéticos, para que Wireshark e tcpdump abram a captura, e o PcapReader,
+// que devolve os payloads UDP de uma captura (usado pelo modo --replay).
+#include <chrono>       // Para o timestamp de cada registro.
+#include <cstdint>      // Para tipos inteiros de largura fixa.
+#include <cstdio>       // Para FILE*, fopen, fread e fwrite.
+#include <cstring>      // Para std::memcpy.
+#include <netinet/in.h> // Para sockaddr_in.
+
+namespace slow {
+
+// Cabeçalho global do pcap (microssegundos, versão 2.4).
+struct PcapFileHeader {
+    uint32_t magic    = 0xa1b2c3d4;
+    uint16_t major    = 2, minor = 4;
+    int32_t  thiszone = 0;
+    uint32_t sigfigs  = 0;
+    uint32_t snaplen  = 65535;
+    uint32_t linktype = 101; // LINKTYPE_RAW: cada pacote começa no cabeçalho IP.
+};
+struct PcapRecordHeader {
+    uint32_t ts_sec, ts_usec, incl_len, orig_len;
+};
+static_assert(sizeof(PcapFileHeader) == 24 && sizeof(PcapRecordHeader) == 16);
+
+constexpr size_t IP_HDR = 20, UDP_HDR = 8;
+
+// ───────────────────────── PcapWriter ─────────────────────────
+class PcapWriter {
+public:
+    PcapWriter() = default;
+    ~PcapWriter() { close(); }
+    PcapWriter(const PcapWriter&)            = delete;
+    PcapWriter& operator=(const PcapWriter&) = delete;
+
+    // Abre a captura. `local` e `remote` (em ordem de rede) viram os
+    // endereços e portas dos cabeçalhos IPv4/UDP sintéticos.
+    bool open(const char* path, const sockaddr_in& local, const sockaddr_in& remote) {
+        close();
+        f_ = std::fopen(path, "wb");
+        if (!f_) return false;
+        std::setvbuf(f_, nullptr, _IOFBF, 1 << 16);
+        local_ = local; remote_ = remote;
+        PcapFileHeader h;
+        std::fwrite(&h, sizeof(h), 1, f_);
+        return true;
+    }
+    void close() {
+        if (f_) std::fclose(f_);
+        f_ = nullptr;
+    }
+    bool active() const { return f_ != nullptr; }
+
+    // Grava um datagrama; `outbound` diz se ele saiu deste lado.
+    void write(bool outbound, const uint8_t* data, size_t len) {
+        if (!f_) return;
+        const sockaddr_in& src = outbound ? local_ : remote_;
+        const sockaddr_in& dst = outbound ? remote_ : local_;
+        uint8_t hdr[IP_HDR + UDP_HDR];
+        uint16_t total = static_cast<uint16_t>(IP_HDR + UDP_HDR + len);
+
+        // IPv4 sem opções, DF, TTL 64, protocolo UDP.
+        hdr[0] = 0x45; hdr[1] = 0;
+        put16be(hdr + 2, total);
+        put16be(hdr + 4, ip_id_++);
+        put16be(hdr + 6, 0x4000);
+        hdr[8] = 64; hdr[9] = 17;
+        put16be(hdr + 10, 0);
+        std::memcpy(hdr + 12, &src.sin_addr, 4);
+        std::memcpy(hdr + 16, &dst.sin_addr, 4);
+        put16be(hdr + 10, ip_checksum(hdr));
+
+        // UDP (checksum 0 = ausente, permitido em IPv4).
+        std::memcpy(hdr + 20, &src.sin_port, 2);
+        std::memcpy(hdr + 22, &dst.sin_port, 2);
+        put16be(hdr + 24, static_cast<uint16_t>(UDP_HDR + len));
+        put16be(hdr + 26, 0);
+
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        PcapRecordHeader r{static_cast<uint32_t>(us / 1000000), static_cast<uint32_t>(us % 1000000),
+                           total, total};
+        std::fwrite(&r, sizeof(r), 1, f_);
+        std::fwrite(hdr, sizeof(hdr), 1, f_);
+        std::fwrite(data, 1, len, f_);
+    }
+
+private:
+    static void put16be(uint8_t* p, uint16_t x) {
+        p[0] = static_cast<uint8_t>(x >> 8);
+        p[1] = static_cast<uint8_t>(x);
+    }
+    static uint16_t ip_checksum(const uint8_t* h) {
+        uint32_t sum = 0;
+        for (size_t i = 0; i < IP_HDR; i += 2) sum += static_cast<uint32_t>(h[i] << 8 | h[i + 1]);
+        while (sum >> 16) sum = (sum & 0xFFFF) + (sum >> 16);
+        return static_cast<uint16_t>(~sum);
+    }
+
+    std::FILE*  f_ = nullptr;
+    sockaddr_in local_{}, remote_{};
+    uint16_t    ip_id_ = 0;
+};
+
+// ───────────────────────── PcapReader ─────────────────────────
+// Lê capturas LINKTYPE_RAW de IPv4/UDP (como as do PcapWriter) e devolve o
+// payload UDP de cada registro, com as portas de origem e destino.
+class PcapReader {
+public:
+    ~PcapReader() { if (f_) std::fclose(f_); }
+
+    bool open(const char* path) {
+        f_ = std::fopen(path, "rb");
+        if (!f_) return false;
+        PcapFileHeader h;
+        return std::fread(&h, sizeof(h), 1, f_) == 1 && h.magic == 0xa1b2c3d4 && h.linktype == 101;
+    }
+
+    // Próximo datagrama UDP: copia o payload para `out` (até `cap` bytes) e
+    // retorna o tamanho, ou -1 no fim do arquivo. Registros que não são
+    // IPv4/UDP são pulados.
+    long next(uint8_t* out, size_t cap, uint16_t& sport, uint16_t& dport) {
+        PcapRecordHeader r;
+        while (f_ && std::fread(&r, sizeof(r), 1, f_) == 1) {
+            if (r.incl_len > sizeof(buf_) || std::fread(buf_, 1, r.incl_len, f_) != r.incl_len)
+                return -1;
+            size_t ihl = static_cast<size_t>(buf_[0] & 0x0F) * 4;
+            if ((buf_[0] >> 4) != 4 || buf_[9] != 17 || r.incl_len < ihl + UDP_HDR) continue;
+            const uint8_t* udp = buf_ + ihl;
+            sport = static_cast<uint16_t>(udp[0] << 8 | udp[1]);
+            dport = static_cast<uint16_t>(udp[2] << 8 | udp[3]);
+            size_t len = r.incl_len - ihl - UDP_HDR;
+            if (len > cap) len = cap;
+            std::memcpy(out, udp + UDP_HDR, len);
+            return static_cast<long>(len);
+        }
+        return -1;
+    }
+
+private:
+    std::FILE* f_ = nullptr;
+    uint8_t    buf_[65535];
+};
+
+} // namespace slow
@@ -7,15 +7,19 @@
 // Ele gerencia a conexão e o envio de dados, alem do  estado para funcionalidade de "revive".
 
 #include "session.hpp"     // Inclui a classe Session, que gerencia a lógica do protocolo.
+#include "trace_log.hpp"   // Inclui o registro binário assíncrono dos pacotes.
+#include "pcap.hpp"        // Inclui a captura pcap (--pcap) e sua leitura (--replay).
+#include "metrics.hpp"     // Inclui o exportador de métricas (--metrics).
+#include "msg_trace.hpp"   // Inclui o rastreio do ciclo de vida das mensagens (--msgtrace).
+#include "series.hpp"      // Inclui a série temporal da conexão (--series).
+#include "alloc_check.hpp" // Inclui a contagem de alocações (build `make alloccheck`).
 #include <arpa/inet.h>     // Para funções de conversão de endereço de rede (inet_ntoa).
 #include <fstream>         // Para manipulação de arquivos (leitura/escrita de estado e mensagem).
 #include <getopt.h>        // Para análise de argumentos de linha de comando (getopt_long).
 #include <iomanip>         // Para formatação de saída.
 #include <iostream>        // Para entrada/saída padrão.
-#include <map>             // Para std::map, usado na remontagem de fragmentos (mantém ordem).
 #include <netdb.h>         // Para getaddrinfo, para resolução de nomes de host.
 #include <poll.h>          // Para poll, para monitorar eventos de socket (leitura disponível).
-#include <unordered_map>   // Para std::unordered_map, usado na remontagem de fragmentos (por fid).
 
 using namespace slow; // Usa o namespace slow para evitar prefixar tudo com slow::
 
@@ -23,6 +27,19 @@ using namespace slow; // Usa o namespace slow para evitar prefixar tudo com slow
 constexpr uint16_t PORT = 7033;
 constexpr char     HOST[] = "slow.gmelodie.com";
 
+/*──────── configuração ─────────*/
+// Parâmetros de linha de comando repassados aos fluxos de sessão.
+struct Config {
+    int      rto       = 800;  // Retransmission Timeout (ms).
+    unsigned ack_every = 2;    // Delayed ACK: confirma a cada N pacotes de dados...
+    int      ack_delay = 40;   // ...ou após este atraso (ms).
+    uint8_t  wscale    = 0;    // Window scale oferecido no CONNECT (0 = não oferece).
+    bool     nack      = false; // Oferece NACK de fragmentos no CONNECT.
+    uint8_t  fec_n     = 0;    // FEC: grupos de N fragmentos...
+    uint8_t  fec_k     = 0;    // ...com K paridades cada (0:0 = não oferece).
+    bool     tstamp    = false; // Oferece timestamps (amostras de RTT sem ambiguidade).
+};
+
 /*──────── socket helpers ─────────*/
 // Resolve um hostname para um endereço IPv4 (sockaddr_in).
 static sockaddr_in resolve(const char* h) {
@@ -50,23 +67,142 @@ static int make_sock(const sockaddr_in& s, int to_ms) {
     return fd;
 }
 
+/*──────── enlaces: socket ou replay ─────────*/
+// O laço da sessão só conversa com um "enlace" (send/recv). SockLink fala com
+// o central por UDP e grava cada datagrama na captura pcap, se aberta;
+// ReplayLink devolve, sem esperar, os datagramas do central de uma captura.
+static PcapWriter pcap; // Captura dos datagramas (--pcap); inativa se não aberta.
+
+struct SockLink {
+    int sock;
+
+    void send(const uint8_t* raw, size_t len) {
+        ::send(sock, raw, len, 0);
+        pcap.write(true, raw, len);
+    }
+    // Espera até `wait_ms` (-1 = recv bloqueante, limitado pelo SO_RCVTIMEO)
+    // por um datagrama. Retorna o tamanho, 0 se nada chegou ou -1 se o enlace
+    // terminou (nunca, para um socket).
+    ssize_t recv(uint8_t* buf, size_t cap, int wait_ms) {
+        if (wait_ms >= 0) {
+            pollfd pfd{sock, POLLIN, 0};
+            if (poll(&pfd, 1, wait_ms) <= 0 || !(pfd.revents & POLLIN)) return 0;
+        }
+        ssize_t n = ::recv(sock, buf, cap, 0);
+        if (n <= 0) return 0;
+        pcap.write(false, buf, static_cast<size_t>(n));
+        return n;
+    }
+};
+
+struct ReplayLink {
+    PcapReader& in;
+    size_t sent = 0, received = 0;
+
+    void send(const uint8_t*, size_t) { ++sent; } // A sessão gera os próprios envios.
+    ssize_t recv(uint8_t* buf, size_t cap, int) {
+        uint16_t sport, dport;
+        long n;
+        while ((n = in.next(buf, cap, sport, dport)) >= 0)
+            if (sport == PORT) { ++received; return n; } // Só o que veio do central.
+        return -1; // Fim da captura.
+    }
+};
+
 /*──────── Fragment reassembly helper ────────*/
 // Estrutura para auxiliar na remontagem de fragmentos de dados.
 struct FragBuf {
-     // Mapa que armazena as partes do fragmento, indexadas pelo Fragment Offset (fo).
-    // Garante que os fragmentos são armazenados em ordem.
-    std::map<uint8_t, std::vector<uint8_t>> parts;
-    bool   last = false;
-    uint8_t max  = 0; // O maior Fragment Offset esperado (último fragmento).
-    std::vector<uint8_t> finish() {
-         // Só retorna o payload completo se:
+    // Partes indexadas pelo Fragment Offset (fo). Cada parte é o datagrama
+    // recebido inteiro (buffer do pool); o payload começa em Packet::HDR_SIZE.
+    // O vetor só cresce: após clear() a capacidade é reaproveitada.
+    std::vector<PacketBuf> parts;
+    std::vector<PacketBuf> parity; // Paridades (FEC) ainda não usadas, datagramas inteiros.
+    size_t  count = 0;     // Quantas partes distintas já chegaram.
+    bool    last  = false;
+    uint8_t max   = 0; // O maior Fragment Offset esperado (último fragmento).
+    size_t  nack_from = 0; // Lacunas abaixo deste fo já foram reportadas por NACK.
+
+    void put(uint8_t fo, PacketBuf&& raw) {
+        if (parts.size() <= fo) parts.resize(fo + 1);
+        if (!parts[fo]) ++count;
+        parts[fo] = std::move(raw);
+    }
+    // `data_off` é onde os bytes da mensagem começam em cada parte (cabeçalho
+    // e, se negociado, o prefixo de timestamps).
+    bool finish(std::vector<uint8_t>& all, size_t data_off) {
+         // Só monta o payload completo se:
         // 1. O último fragmento foi recebido (last == true).
         // 2. O número de partes recebidas é igual ao número total de partes esperadas (max + 1).
-        if (!last || parts.size() != static_cast<size_t>(max + 1)) return {};
-        std::vector<uint8_t> all;
-        for (uint8_t i = 0; i <= max; ++i)
-            all.insert(all.end(), parts[i].begin(), parts[i].end());
-        return all;
+        if (!last || count != static_cast<size_t>(max + 1)) return false;
+        all.clear();
+        for (size_t i = 0; i <= max; ++i)
+            all.insert(all.end(), parts[i].data() + data_off,
+                       parts[i].data() + parts[i].size());
+        return true;
+    }
+    // Acrescenta a `out` os fo ausentes abaixo de `upto` que ainda não foram
+    // reportados. Retorna true se algum foi incluído.
+    bool collect_missing(uint8_t fid, uint8_t upto, Payload& out) {
+        bool any = false;
+        for (size_t fo = nack_from; fo < upto; ++fo)
+            if (fo >= parts.size() || !parts[fo])
+                any = Nack::add(out, fid, static_cast<uint8_t>(fo)) || any;
+        nack_from = std::max(nack_from, static_cast<size_t>(upto) + 1);
+        return any;
+    }
+    // Usa as paridades guardadas para reconstruir fragmentos: uma paridade com
+    // exatamente um fragmento coberto ausente o recupera; com todos presentes
+    // ela é descartada. Cada fragmento recuperado (datagrama com cabeçalho
+    // sintetizado) é entregue a `on_recovered(seqnum, fo, ultimo, buf)`.
+    template <class F>
+    void recover(BufferPool& pool, F&& on_recovered) {
+        for (size_t p = 0; p < parity.size();) {
+            const uint8_t* praw = parity[p].data();
+            const uint8_t* ext  = praw + Packet::HDR_SIZE;
+            size_t g = praw[Packet::OFF_FO], n = Parity::n(ext), k = Parity::k(ext);
+            uint32_t seq0 = Parity::seq0(ext);
+            size_t missing = 0, absent = 0;
+            bool   stale   = false;
+            for (size_t i = g + Parity::j(ext); i < g + n; i += k) {
+                if (i >= parts.size() || !parts[i]) { missing = i; ++absent; continue; }
+                // Um fragmento de outra mensagem com o mesmo fid: paridade velha.
+                if (Packet::read32le(parts[i].data() + Packet::OFF_SEQNUM) != seq0 + (i - g))
+                    stale = true;
+            }
+            if (absent > 1 && !stale) { ++p; continue; } // Ainda faltam fragmentos demais.
+            if (absent == 1 && !stale) {
+                const uint8_t* x = ext + Parity::HDR;
+                size_t   width = parity[p].size() - Packet::HDR_SIZE - Parity::HDR;
+                uint16_t len   = Parity::len_xor(ext);
+                PacketBuf out(pool);
+                uint8_t* d = out.data() + Packet::HDR_SIZE;
+                std::copy(x, x + width, d);
+                for (size_t i = g + Parity::j(ext); i < g + n; i += k) {
+                    if (i == missing) continue;
+                    size_t plen = parts[i].size() - Packet::HDR_SIZE;
+                    const uint8_t* pd = parts[i].data() + Packet::HDR_SIZE;
+                    for (size_t b = 0; b < plen; ++b) d[b] ^= pd[b];
+                    len ^= static_cast<uint16_t>(plen);
+                }
+                if (len <= width) {
+                    bool end = Parity::end(ext) && missing == g + n - 1;
+                    std::copy(praw, praw + Packet::HDR_SIZE, out.data());
+                    out.data()[Packet::OFF_FLAGS] = static_cast<uint8_t>(
+                        (praw[Packet::OFF_FLAGS] & ~0x1Fu) | FLAG_ACK | (end ? 0 : FLAG_MOREBITS));
+                    out.data()[Packet::OFF_FO] = static_cast<uint8_t>(missing);
+                    Packet::patch_seqnum(out.data(), seq0 + static_cast<uint32_t>(missing - g));
+                    out.resize(Packet::HDR_SIZE + len);
+                    on_recovered(seq0 + static_cast<uint32_t>(missing - g),
+                                 static_cast<uint8_t>(missing), end, std::move(out));
+                }
+            }
+            parity.erase(parity.begin() + static_cast<std::ptrdiff_t>(p)); // Usada ou inútil.
+        }
+    }
+    void clear() {
+        for (auto& p : parts) p.reset();
+        parity.clear();
+        count = 0; last = false; max = 0; nack_from = 0;
     }
 };
 
@@ -97,68 +233,239 @@ struct StateDisk {
 };
 
 /*──────────────────────────────────────────────────────────────────*/
-// Função auxiliar para imprimir detalhes de um pacote (útil para depuração).
-static void dump_packet(const char* dir, const char* tag,
-                        const Packet& p, std::size_t raw_sz) {
-    std::cout << "\n" << dir << " " << tag << " seq=" << p.seqnum
-              << " (" << raw_sz << "B)\n" << p;
+// Registro binário dos pacotes (--trace). Enquanto não for aberto, registrar
+// não faz nada; o arquivo é lido com ./slowtrace.
+static TraceLog trace_log;
+
+// Exportador de métricas (--metrics). Enquanto não for aberto, o laço de I/O
+// não mede nem publica nada.
+static MetricsExporter metrics;
+
+// Ciclo de vida das mensagens (--msgtrace), exportado em JSON do Chrome ao fechar.
+static MsgTrace msg_trace;
+
+// Série temporal de RTT, RTO, bytes em voo e janelas (--series).
+static SeriesRecorder series;
+
+// Registra um pacote enviado/recebido conforme TRACE_LEVEL: no nível binário
+// só copia o cabeçalho e uma prévia do payload para o anel do TraceLog (a
+// formatação é feita offline); no nível texto também imprime o pacote por
+// extenso. Com TRACE_OFF o corpo é vazio e as chamadas somem na compilação.
+static void dump_packet(TraceDir dir, TraceTag tag, const uint8_t* raw, std::size_t raw_sz) {
+    if constexpr (TRACE_LEVEL >= TRACE_BINARY)
+        trace_log.record(dir, tag, raw, raw_sz);
+    if constexpr (TRACE_LEVEL >= TRACE_TEXT)
+        std::cout << "\n" << trace_dir_arrow(dir) << " " << trace_tag_name(tag)
+                  << " seq=" << Packet::deserialize(raw, raw_sz).seqnum
+                  << " (" << raw_sz << "B)\n" << Packet::deserialize(raw, raw_sz);
 }
 
 /*──────────────── helper para fluxo de send/recv ────────────────*/
 // Função principal que gerencia o loop de envio e recebimento de pacotes durante uma sessão SLOW ativa.
-static void drive_session(int sock, Session& sess,
+template <class Link>
+static void drive_session(Link& link, Session& sess,
                           bool& waiting_dc_ack,
                           const std::string& fsave,
-                          int rto) {
+                          const Config& cfg) {
+
+    std::array<FragBuf, 256> reasm;  // Remontagem indexada diretamente pelo fid.
+    std::vector<uint8_t> all;        // Mensagem remontada (capacidade reaproveitada).
+    // Reserva já a maior mensagem possível (256 fragmentos, fo de 8 bits): a
+    // primeira mensagem grande não faz o laço alocar no meio da sessão.
+    all.reserve(256 * Payload::CAPACITY);
+    std::vector<size_t>  ready;      // Slots prontos para envio (capacidade reaproveitada).
+
+    Payload nack;                    // Payload do NACK em construção.
+    Payload tsack;                   // Payload do EXT_TSTAMP (ACK puro com timestamps).
+    const size_t data_off = sess.data_offset();
+
+    // Envia um pacote de controle codificado a partir do template da sessão
+    // (sem dados, ou com o payload de um pacote de extensão).
+    auto tx_ctl = [&](uint8_t flags, uint32_t seqnum, uint32_t acknum,
+                      uint16_t window, TraceTag tag,
+                      const Payload* ext = nullptr) {
+        uint8_t raw[MTU_BUF];
+        size_t len = ext ? sess.encode_control(raw, flags, seqnum, acknum, window,
+                                               ext->data(), ext->size())
+                         : sess.encode_control(raw, flags, seqnum, acknum, window);
+        link.send(raw, len);
+        sess.note_tx_ctl(len);
+        SLOW_PROBE3(tx, seqnum, len, static_cast<int>(tag));
+        dump_packet(TraceDir::Tx, tag, raw, len);
+    };
+
+    // Coloca um fragmento de dados (recebido ou recuperado por FEC) na remontagem.
+    auto store = [&](FragBuf& fb, uint8_t fo, bool msg_end, PacketBuf&& raw) {
+        sess.consume_local_window(raw.size() - data_off);
+        fb.put(fo, std::move(raw));
+        if (msg_end) { fb.last = true; fb.max = fo; }
+    };
+    // Tenta recuperar fragmentos pelas paridades do fid e, se a mensagem ficou
+    // completa, a entrega. Retorna true se algum fragmento foi recuperado.
+    auto complete = [&](uint8_t fid) {
+        auto& fb = reasm[fid];
+        bool recovered = false;
+        if (sess.fec_enabled())
+            fb.recover(sess.pool(), [&](uint32_t seqnum, uint8_t fo, bool end, PacketBuf&& raw) {
+                if (!sess.accept_data_len(raw.size())) return;
+                auto res = sess.note_data_seq(seqnum);
+                if (res == RxTracker::Result::Duplicate || res == RxTracker::Result::OutOfWindow)
+                    return; // Chegou por outro caminho (ou retransmissão) antes.
+                dump_packet(TraceDir::Rx, TraceTag::FecRec, raw.data(), raw.size());
+                sess.note_fec_recovered();
+                store(fb, fo, end, std::move(raw));
+                recovered = true;
+            });
+        if (fb.finish(all, data_off)) {
+            sess.note_reassembled(fb.max + 1u);
+            SLOW_PROBE3(reassembly__complete, fid, fb.max + 1u, all.size());
+            std::cout << "\n### PAYLOAD (" << all.size() << "B) ###\n";
+            for (char c : all) std::cout << c;
+            std::cout << "\n################################\n";
+            fb.clear();
+            sess.release_local_window(all.size());
+        }
+        return recovered;
+    };
 
-    pollfd pfd{sock, POLLIN, 0};
-    std::unordered_map<uint8_t, FragBuf> reasm;
+    // Métricas: o snapshot é montado e publicado a cada 100 ms (a taxa de
+    // pacotes, recalculada a cada ~1 s).
+    LoopTimer loop;
+    auto pub_at  = std::chrono::steady_clock::time_point{};
+    auto rate_at = std::chrono::steady_clock::now();
+    uint64_t rate_pkts = 0;
+    double   pps = 0;
+    auto publish_metrics = [&](std::chrono::steady_clock::time_point now) {
+        MetricsSnapshot m;
+        m.stats = sess.stats();
+        uint64_t pkts = m.stats.packets_sent + m.stats.packets_rcvd;
+        double secs = std::chrono::duration<double>(now - rate_at).count();
+        if (secs >= 1.0) {
+            pps = static_cast<double>(pkts - rate_pkts) / secs;
+            rate_pkts = pkts;
+            rate_at   = now;
+        }
+        m.packets_per_s = pps;
+        for (const auto& fb : reasm) m.reasm_bytes += (fb.count + fb.parity.size()) * MTU_BUF;
+        m.pool_bytes   = sess.pool().in_use() * MTU_BUF;
+        m.loop_iters   = loop.iterations();
+        m.loop_busy_ns = loop.busy_ns();
+        m.loop_max_ns  = loop.take_max_ns();
+        metrics.publish(m);
+        pub_at = now;
+    };
 
-    auto tx = [&](const Packet& p, const char* tag) {
-        auto raw = p.serialize();
-        send(sock, raw.data(), raw.size(), 0);
-        dump_packet("»»", tag, p, raw.size());
+    // Série temporal: uma amostra por ACK ou a cada intervalo.
+    auto sample_series = [&](std::chrono::steady_clock::time_point now) {
+        SeriesPoint p;
+        p.rtt_us        = sess.last_rtt_us();
+        p.srtt_us       = sess.srtt_us();
+        p.rttvar_us     = sess.rttvar_us();
+        p.rto_ms        = cfg.rto;
+        p.in_flight     = sess.in_flight();
+        p.remote_window = sess.remote_window();
+        p.local_window  = sess.local_window_left();
+        p.retx          = sess.retransmits();
+        series.write(p, now);
     };
 
     while (true) {
+        // Build instrumentado: arma a contagem de alocações depois do aquecimento.
+        if constexpr (alloc_check::ENABLED) {
+            if (!alloc_check::armed() && !alloc_check::failed) {
+                SessionStats st = sess.stats();
+                if (st.packets_sent + st.packets_rcvd >= alloc_check::WARMUP) alloc_check::arm();
+            }
+        }
+        if (series.active() && series.due(std::chrono::steady_clock::now()))
+            sample_series(std::chrono::steady_clock::now());
+        if (metrics.active()) {
+            auto t = std::chrono::steady_clock::now();
+            loop.begin(t);
+            if (t - pub_at >= std::chrono::milliseconds(100)) publish_metrics(t);
+        }
         // 1. Fase de Envio: Verifica e envia/retransmite pacotes da fila.
-        for (auto* ob : sess.ready_to_send(rto)) {
-            const char* tag = "DATA/FRAG";
-            if (ob->first_sent.time_since_epoch().count() != 0) {
-                tag = "RETX";
-            } else if (ob->pkt.flags & FLAG_REVIVE) {
-                tag = "REVIVE";
+        sess.ready_to_send(cfg.rto, ready);
+        for (size_t slot : ready) {
+            TraceTag tag = TraceTag::Data;
+            if (sess.is_tail_probe(slot)) {
+                tag = TraceTag::Tlp;
+            } else if (sess.was_sent(slot)) {
+                tag = TraceTag::Retx;
+            } else if (sess.tx_flags(slot) & FLAG_REVIVE) {
+                tag = TraceTag::Revive;
             }
-            tx(ob->pkt, tag);
-
-            if (ob->first_sent.time_since_epoch().count() == 0)
-                ob->first_sent = std::chrono::steady_clock::now();
-            sess.mark_sent(ob);
+            const auto& raw = sess.prepare_tx(slot);
+            link.send(raw.data(), raw.size());
+            SLOW_PROBE3(tx, sess.tx_seq(slot), raw.size(), static_cast<int>(tag));
+            dump_packet(TraceDir::Tx, tag, raw.data(), raw.size());
+            sess.mark_sent(slot);
+        }
+        // FEC: as paridades de um grupo saem logo depois do último fragmento dele.
+        while (const PacketBuf* par = sess.next_parity()) {
+            link.send(par->data(), par->size());
+            SLOW_PROBE3(tx, Packet::read32le(par->data() + Packet::OFF_SEQNUM), par->size(),
+                        static_cast<int>(TraceTag::Parity));
+            dump_packet(TraceDir::Tx, TraceTag::Parity, par->data(), par->size());
+            sess.parity_sent();
+        }
+        // ACK atrasado: sai quando completa N pacotes, vence o prazo ou é urgente.
+        // Se algum pacote de dados saiu acima, o ACK já foi de carona (piggyback)
+        // e não há nada pendente aqui.
+        if (sess.ack_due(std::chrono::steady_clock::now())) {
+            if (sess.timestamps_enabled()) {
+                Timestamps::ack(tsack, sess.ts_now(), sess.ts_recent());
+                tx_ctl(FLAG_ACK | FLAG_ACCEPT, sess.last_rx_seq(), sess.last_rx_seq(),
+                       sess.advertised_window(), TraceTag::AckPure, &tsack);
+            } else {
+                tx_ctl(FLAG_ACK, sess.last_rx_seq(), sess.last_rx_seq(),
+                       sess.advertised_window(), TraceTag::AckPure);
+            }
+            sess.ack_sent();
+        }
+        // Persist timer: com a janela remota fechada e nada em voo, sonda o central
+        // com um ACK sem dados que repete o último seqnum já confirmado por ele
+        // (uma duplicata: não consome sequência e provoca um novo ACK com a janela).
+        if (sess.persist_probe_due(cfg.rto, std::chrono::steady_clock::now())) {
+            tx_ctl(FLAG_ACK, sess.last_ack(), sess.last_rx_seq(),
+                   sess.advertised_window(), TraceTag::Probe);
+            sess.ack_sent();
         }
 // 2. Lógica de Desconexão: Se não há mais pacotes para enviar e ainda não está esperando o ACK de desconexão.
         if (!waiting_dc_ack && sess.empty()) {
-            Packet d{};
-            d.sid    = sess.sid();
-            d.sttl   = sess.sttl();
-            d.flags  = FLAG_CONNECT | FLAG_REVIVE | FLAG_ACK;
-            d.seqnum = sess.take_seq();
-            d.acknum = sess.last_rx_seq();
-            d.window = 0;
-            tx(d, "DISCONNECT");
+            tx_ctl(FLAG_CONNECT | FLAG_REVIVE | FLAG_ACK, sess.take_seq(),
+                   sess.last_rx_seq(), 0, TraceTag::Disconnect);
+            sess.ack_sent(); // O DISCONNECT também carrega o acknum atual.
             waiting_dc_ack = true;
         }
-// 3. Fase de Recebimento: Usa `poll` para esperar por dados no socket com um timeout de 100ms.
-        int r = poll(&pfd, 1, 100);
-        if (r > 0 && (pfd.revents & POLLIN)) {
-            uint8_t buf[2048];
-            ssize_t n = recv(sock, buf, sizeof(buf), 0);
-            if (n <= 0) continue;
-            Packet pk = Packet::deserialize(buf, n);
-            dump_packet("««", "RX", pk, n);
-
-            sess.note_rx_seq(pk.seqnum);
-            if (pk.flags & FLAG_ACK)
-                sess.handle_ack(pk.acknum, pk.window, pk.sttl);
+// 3. Fase de Recebimento: Usa `poll` para esperar por dados no socket com um timeout de 100ms
+        // (ou menos, se houver um ACK atrasado ou uma sonda com prazo mais curto).
+        auto now  = std::chrono::steady_clock::now();
+        int  wait = 100;
+        for (int w : {sess.ack_wait_ms(now), sess.persist_wait_ms(now),
+                      sess.tlp_wait_ms(cfg.rto, now)})
+            if (w >= 0 && w < wait) wait = w;
+        PacketBuf rx(sess.pool());
+        if (metrics.active()) loop.pause(now);
+        ssize_t n = link.recv(rx.data(), MTU_BUF, wait);
+        if (metrics.active()) loop.resume(std::chrono::steady_clock::now());
+        if (n < 0) break; // O enlace terminou (fim da captura no replay).
+        if (n > 0) {
+            rx.resize(n);
+            sess.note_rx(n);
+            dump_packet(TraceDir::Rx, TraceTag::Rx, rx.data(), n);
+            Packet pk = Packet::deserialize(rx.data(), n);
+            SLOW_PROBE3(rx, pk.seqnum, n, pk.flags);
+
+            // Só pacotes de dados entram no rastreador de seqnums: ACKs puros do
+            // central ecoam o seqnum confirmado (como o nosso ACK-PURE) e não
+            // pertencem ao espaço de sequência dele.
+            uint32_t tsval = 0, tsecr = 0;
+            bool has_ts = sess.timestamps_enabled() && Timestamps::read(pk, tsval, tsecr);
+            if (pk.flags & FLAG_ACK) {
+                sess.handle_ack(pk.acknum, pk.window, pk.sttl, tsecr);
+                if (series.active() && series.per_ack()) sample_series(std::chrono::steady_clock::now());
+            }
 // Lógica para finalizar a sessão se estiver esperando o ACK de desconexão e o pacote recebido for um ACK que confirma o pacote de desconexão.
             if (waiting_dc_ack && (pk.flags & FLAG_ACK) && pk.seqnum == sess.last_ack()) {
                 if (!fsave.empty()) {
@@ -169,65 +476,125 @@ static void drive_session(int sock, Session& sess,
                 break;
             }
 
+            // Pacote de extensão (só existe se negociado): não consome seqnum
+            // nem entra na remontagem.
+            if (sess.extensions_enabled() && is_extension(pk)) {
+                if (pk.data[0] == EXT_NACK && sess.nack_enabled()) {
+                    sess.handle_nack(pk.data);
+                } else if (pk.data[0] == EXT_TSTAMP && has_ts) {
+                    sess.note_ts(tsval);
+                } else if (pk.data[0] == EXT_PARITY && sess.fec_enabled() && pk.fid != 0 &&
+                           Parity::valid(pk.data.data(), pk.data.size())) {
+                    // Paridade de um grupo que ainda não chegou inteiro: guarda e
+                    // tenta recuperar; se recuperou, o contíguo pode ter avançado.
+                    const uint8_t* ext = pk.data.data();
+                    uint32_t group_end = Parity::seq0(ext) + Parity::n(ext) - 1;
+                    if (seq_gt(group_end, sess.last_rx_seq())) {
+                        reasm[pk.fid].parity.push_back(std::move(rx));
+                        if (complete(pk.fid)) sess.schedule_ack(true);
+                    }
+                }
+                continue;
+            }
+
             if (!pk.data.empty()) {
-                sess.consume_local_window(pk.data.size());
+                // Sem espaço para o prefixo de timestamps: descartado antes de
+                // consumir janela ou entrar na remontagem.
+                if (!sess.accept_data_len(static_cast<size_t>(n))) continue;
+                bool had_gap = sess.rx_has_gap();
+                auto res     = sess.note_data_seq(pk.seqnum);
+                if (res == RxTracker::Result::Duplicate || res == RxTracker::Result::OutOfWindow) {
+                    // Duplicata (nosso ACK provavelmente se perdeu) ou fora da janela:
+                    // não consome janela nem remonta, só reconfirma o contíguo.
+                    sess.schedule_ack(true);
+                    continue;
+                }
+                if (has_ts) sess.note_ts(tsval);
                 auto& fb = reasm[pk.fid];
-                fb.parts[pk.fo] = pk.data;
-                if (!(pk.flags & FLAG_MOREBITS)) { fb.last = true; fb.max = pk.fo; }
-                auto all = fb.finish();
-                if (!all.empty()) {
-                    std::cout << "\n### PAYLOAD (" << all.size() << "B) ###\n";
-                    for (char c : all) std::cout << c;
-                    std::cout << "\n################################\n";
-                    reasm.erase(pk.fid);
-                    sess.release_local_window(all.size());
+                bool msg_end = !(pk.flags & FLAG_MOREBITS);
+                store(fb, pk.fo, msg_end, std::move(rx));
+                // Fragmentos que pularam um fo: pede exatamente os que faltam,
+                // sem esperar o timer de retransmissão do central.
+                bool nacked = false;
+                if (sess.nack_enabled() && pk.fid != 0) {
+                    Nack::begin(nack);
+                    if (fb.collect_missing(pk.fid, pk.fo, nack)) {
+                        tx_ctl(FLAG_ACK | FLAG_ACCEPT, sess.last_rx_seq(), sess.last_rx_seq(),
+                               sess.advertised_window(), TraceTag::Nack, &nack);
+                        sess.ack_sent();
+                        nacked = true;
+                    }
                 }
-                // Envia um ACK "puro" (sem dados) para confirmar o recebimento do pacote de dados.
-                Packet ack{};
-                ack.sid    = sess.sid();
-                ack.sttl   = sess.sttl();
-                ack.flags  = FLAG_ACK;
-                ack.seqnum = ack.acknum = pk.seqnum;
-                ack.window = sess.local_window_left();
-                tx(ack, "ACK-PURE");
+                bool recovered = complete(pk.fid);
+                // Agenda o ACK "puro" (sem dados) em vez de enviá-lo na hora: lacunas
+                // (ou o preenchimento de uma) e fim de mensagem (sem MOREBITS)
+                // são confirmados imediatamente.
+                // Se um NACK acabou de sair, ele já levou o acknum atual: a lacuna
+                // não torna urgente outro ACK.
+                bool gap = (res == RxTracker::Result::OutOfOrder || had_gap) && !nacked;
+                sess.schedule_ack(gap || msg_end || recovered);
             }
         }
     }
+    alloc_check::report();
+    SLOW_PROBE2(teardown, sess.stats().packets_sent, sess.retransmits());
+    if (metrics.active()) publish_metrics(std::chrono::steady_clock::now());
+    std::cout << "\n### ESTATÍSTICAS ###\n" << sess.stats()
+              << "RTT (hist) : " << sess.rtt_histogram() << '\n'
+              << "mensagens  : " << sess.msg_histogram() << '\n';
 }
 
 /*──────────────────────────────────────────────────────────────────*/
 // Inicia uma nova conexão SLOW.
-static void run_connect(int sock, int rto, const std::string& fsave,
+template <class Link>
+static void run_connect(Link& link, const Config& cfg, const std::string& fsave,
                         const std::vector<uint8_t>& payload) {
     Session sess;
+    sess.set_ack_policy(cfg.ack_every, cfg.ack_delay);
+    if (msg_trace.active()) sess.set_msg_trace(&msg_trace);
     bool waiting_dc_ack = false;
 
     Packet conn{};
     conn.flags  = FLAG_CONNECT;
-    conn.window = sess.local_window_left();
+    conn.window = sess.advertised_window();
+    HandshakeOptions offer;
+    if (cfg.wscale) { offer.has_wscale = true; offer.wscale = cfg.wscale; }
+    offer.has_nack = cfg.nack;
+    offer.has_fec  = cfg.fec_n != 0;
+    offer.has_tstamp = cfg.tstamp;
+    offer.encode(conn.data);
     auto raw_conn = conn.serialize();
-    send(sock, raw_conn.data(), raw_conn.size(), 0);
-    dump_packet("»»", "CONNECT", conn, raw_conn.size());
+    link.send(raw_conn.data(), raw_conn.size());
+    dump_packet(TraceDir::Tx, TraceTag::Connect, raw_conn.data(), raw_conn.size());
 // Espera pelo pacote SETUP do servidor.
-    uint8_t buf[64];
-    ssize_t n = recv(sock, buf, sizeof(buf), 0);
+    uint8_t buf[MTU_BUF];
+    ssize_t n = link.recv(buf, sizeof(buf), -1);
     if (n <= 0) { std::cerr << "timeout na recepção do SETUP\n"; exit(1); }
+    dump_packet(TraceDir::Rx, TraceTag::Setup, buf, n);
     Packet setup = Packet::deserialize(buf, n);
-    dump_packet("««", "SETUP", setup, n);
 // Verifica se a conexão foi aceita.
     if (!(setup.flags & FLAG_ACCEPT)) { std::cerr << "Conexão rejeitada (REJECT)\n"; exit(1); }
     sess.establish(setup);
     sess.note_rx_seq(setup.seqnum);
+    // A escala de janela só vale se o central também respondeu com a opção.
+    HandshakeOptions reply = HandshakeOptions::parse(setup.data);
+    if (offer.has_wscale && reply.has_wscale)
+        sess.set_window_scale(reply.wscale, offer.wscale);
+    sess.set_nack(offer.has_nack && reply.has_nack);
+    if (offer.has_fec && reply.has_fec)
+        sess.set_fec(cfg.fec_n, cfg.fec_k);
+    sess.set_timestamps(offer.has_tstamp && reply.has_tstamp);
     if (!payload.empty()) {
         sess.queue_data(payload);
     }
 
-    drive_session(sock, sess, waiting_dc_ack, fsave, rto);
+    drive_session(link, sess, waiting_dc_ack, fsave, cfg);
 }
 
 /*──────────────────────────────────────────────────────────────────*/
 // Tenta reviver uma sessão SLOW existente.
-static void run_revive(int sock, int rto,
+template <class Link>
+static void run_revive(Link& link, const Config& cfg,
                        const std::string& fstate, const std::string& fsave,
                        const std::vector<uint8_t>& payload) {
     StateDisk sd;
@@ -237,6 +604,8 @@ static void run_revive(int sock, int rto,
     }
 
     Session sess;
+    sess.set_ack_policy(cfg.ack_every, cfg.ack_delay);
+    if (msg_trace.active()) sess.set_msg_trace(&msg_trace);
     Packet placeholder_for_establish;
     placeholder_for_establish.sid     = sd.sid;
     placeholder_for_establish.sttl    = sd.sttl;
@@ -250,30 +619,64 @@ static void run_revive(int sock, int rto,
     sess.queue_data(payload, true);
 
     bool waiting_dc_ack = false;
-    drive_session(sock, sess, waiting_dc_ack, fsave, rto);
+    drive_session(link, sess, waiting_dc_ack, fsave, cfg);
 }
 
 /*──────────────────────────────────────────────────────────────────*/
 // Função principal do programa.
 int main(int argc, char* argv[]) {
-    std::string fmsg, fstate, fsave;
+    std::string fmsg, fstate, fsave, ftrace, fpcap, freplay, fmetrics, fmsgtrace, fseries;
+    int series_ms = 0;
     bool revive = false; // Flag para indicar se é uma operação de revive
-    int  rto = 800, rcvto = 1500;
+    Config cfg;
+    int  rcvto = 1500;
      // Opções de linha de comando usando getopt_long.
     option longopts[] = {
         {"msg", 1, 0, 'm'}, {"revive", 1, 0, 'r'}, {"save", 1, 0, 's'},
-        {"rto", 1, 0, 't'},  {"recvto", 1, 0, 'T'}, {0, 0, 0, 0}};
+        {"rto", 1, 0, 't'},  {"recvto", 1, 0, 'T'},
+        {"ack-every", 1, 0, 'a'}, {"ack-delay", 1, 0, 'd'},
+        {"wscale", 1, 0, 'w'}, {"nack", 0, 0, 'n'}, {"fec", 1, 0, 'f'},
+        {"timestamps", 0, 0, 'S'}, {"trace", 1, 0, 'x'},
+        {"pcap", 1, 0, 'p'}, {"replay", 1, 0, 'R'},
+        {"metrics", 1, 0, 'M'}, {"msgtrace", 1, 0, 'L'},
+        {"series", 1, 0, 'V'}, {"series-ms", 1, 0, 'I'}, {0, 0, 0, 0}};
 
     int opt, idx;
      // Loop para processar os argumentos da linha de comando.
-    while ((opt = getopt_long(argc, argv, "m:r:s:t:T:", longopts, &idx)) != -1) {
+    while ((opt = getopt_long(argc, argv, "m:r:s:t:T:a:d:w:nf:Sx:p:R:M:L:V:I:", longopts, &idx)) != -1) {
         if      (opt == 'm') fmsg   = optarg;
         else if (opt == 'r') { fstate = optarg; revive = true; }
         else if (opt == 's') fsave  = optarg;
-        else if (opt == 't') rto    = std::stoi(optarg);
-        else if (opt == 'T') rcvto  = std::stoi(optarg);
+        else if (opt == 't') cfg.rto       = std::stoi(optarg);
+        else if (opt == 'T') rcvto         = std::stoi(optarg);
+        else if (opt == 'a') cfg.ack_every = std::stoul(optarg);
+        else if (opt == 'd') cfg.ack_delay = std::stoi(optarg);
+        else if (opt == 'n') cfg.nack      = true;
+        else if (opt == 'S') cfg.tstamp    = true;
+        else if (opt == 'x') ftrace        = optarg;
+        else if (opt == 'p') fpcap         = optarg;
+        else if (opt == 'R') freplay       = optarg;
+        else if (opt == 'M') fmetrics      = optarg;
+        else if (opt == 'L') fmsgtrace     = optarg;
+        else if (opt == 'V') fseries       = optarg;
+        else if (opt == 'I') series_ms     = std::stoi(optarg);
+        else if (opt == 'w') cfg.wscale    = static_cast<uint8_t>(
+                                 std::clamp(std::stoi(optarg), 0, int{HandshakeOptions::MAX_WSCALE}));
+        else if (opt == 'f') { // N:K, com 1 ≤ K ≤ N ≤ 255.
+            std::string s = optarg;
+            size_t colon  = s.find(':');
+            int n = std::clamp(std::stoi(s.substr(0, colon)), 0, 255);
+            int k = colon == std::string::npos ? 1 : std::stoi(s.substr(colon + 1));
+            cfg.fec_n = static_cast<uint8_t>(n);
+            cfg.fec_k = static_cast<uint8_t>(std::clamp(k, 1, std::max(n, 1)));
+        }
         else {
-            std::cerr << "uso: ./slowclient [--msg F] [--save F] [--revive F]\n";
+            std::cerr << "uso: ./slowclient [--msg F] [--save F] [--revive F]"
+                     " [--rto MS] [--recvto MS] [--ack-every N] [--ack-delay MS]"
+                     " [--wscale N] [--nack] [--fec N:K]"
+                     " [--timestamps] [--trace F] [--pcap F] [--replay F]"
+                     " [--metrics PORTA|SOCKET] [--msgtrace F]"
+                     " [--series F] [--series-ms MS]\n";
             return 1;
         }
     }
@@ -288,12 +691,73 @@ int main(int argc, char* argv[]) {
         payload.assign(default_msg, default_msg + strlen(default_msg));
     }
 
-    int sock = make_sock(resolve(HOST), rcvto); // Cria e conecta o socket ao servidor.
+    if (!ftrace.empty() && TRACE_LEVEL == TRACE_OFF) {
+        std::cerr << "--trace indisponível: compilado com SLOW_TRACE_LEVEL=0\n";
+        return 1;
+    }
+    if (!ftrace.empty() && !trace_log.open(ftrace.c_str())) {
+        std::cerr << "Não foi possível abrir o arquivo de trace: " << ftrace << "\n";
+        return 1;
+    }
+
+    if (!fmsgtrace.empty() && !msg_trace.open(fmsgtrace.c_str())) {
+        std::cerr << "Não foi possível abrir o arquivo de mensagens: " << fmsgtrace << "\n";
+        return 1;
+    }
+    if (!fseries.empty() && !series.open(fseries.c_str(), series_ms)) {
+        std::cerr << "Não foi possível abrir o arquivo da série: " << fseries << "\n";
+        return 1;
+    }
+    if (!fmetrics.empty() && !metrics.open(fmetrics.c_str())) {
+        std::cerr << "Não foi possível abrir o endpoint de métricas: " << fmetrics << "\n";
+        return 1;
+    }
+
+    if (!freplay.empty()) {
+        // Replay: a sessão roda contra os datagramas do central gravados numa
+        // captura (--pcap), sem rede e sem esperar. Use as mesmas opções e
+        // a mesma mensagem da execução original.
+        PcapReader reader;
+        if (!reader.open(freplay.c_str())) {
+            std::cerr << "Captura inválida ou não encontrada: " << freplay << "\n";
+            return 1;
+        }
+        ReplayLink link{reader};
+        auto t0 = std::chrono::steady_clock::now();
+        if (revive) run_revive(link, cfg, fstate, fsave, payload);
+        else        run_connect(link, cfg, fsave, payload);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        std::cout << "[replay: " << link.received << " datagramas recebidos, " << link.sent
+                  << " enviados em " << ms << " ms]\n";
+        trace_log.close();
+        msg_trace.close();
+        series.close();
+        return alloc_check::failed ? 1 : 0;
+    }
+
+    sockaddr_in remote = resolve(HOST);
+    SockLink link{make_sock(remote, rcvto)}; // Cria e conecta o socket ao servidor.
+    if (!fpcap.empty()) {
+        sockaddr_in local{};
+        socklen_t   sl = sizeof(local);
+        getsockname(link.sock, reinterpret_cast<sockaddr*>(&local), &sl);
+        if (!pcap.open(fpcap.c_str(), local, remote)) {
+            std::cerr << "Não foi possível abrir o arquivo pcap: " << fpcap << "\n";
+            return 1;
+        }
+    }
 
     if (revive)
-        run_revive(sock, rto, fstate, fsave, payload); // Inicia a sessão em modo revive.
+        run_revive(link, cfg, fstate, fsave, payload); // Inicia a sessão em modo revive.
     else
-        run_connect(sock, rto, fsave, payload);  // Inicia uma nova conexão.
+        run_connect(link, cfg, fsave, payload);  // Inicia uma nova conexão.
+    pcap.close();
+
+    trace_log.close(); // Esvazia o anel no arquivo antes de sair.
+    msg_trace.close(); // Exporta o JSON do ciclo de vida das mensagens.
+    series.close();
+    if (trace_log.dropped())
+        std::cerr << "[trace: " << trace_log.dropped() << " registros descartados]\n";
 
-    return 0;
-}
\ No newline at end of file
+    return alloc_check::failed ? 1 : 0;
+}
\ No newline at end of file
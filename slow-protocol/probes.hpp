@@ -0,0 +1,37 @@
+#pragma once
+//
+//  probes.hpp  –  Tracepoints estáticos (USDT) do SLOW
+// Este arquivo define as macros SLOW_PROBEn(nome, args...), que viram probes
+// USDT do provedor "slow" quando <sys/sdt.h> (systemtap-sdt-dev) está
+// disponível. Cada probe é um único NOP no código mais uma nota ELF: sem
+// ninguém anexado, o custo é praticamente zero. Com bpftrace ou perf, os
+// probes são ativados em produção sem recompilar, por exemplo:
+//
+//   bpftrace -e 'usdt:./slowclient:slow:retransmit { @[arg2] = count(); }'
+//   perf probe -x ./slowclient sdt_slow:ack__advance
+//
+// Sem <sys/sdt.h>, ou com -DSLOW_USDT=0 (ver Makefile), as macros não geram
+// código nenhum: os argumentos nem são avaliados.
+//
+// Probes (nomes com "__" aparecem com "-" no perf):
+//   establish(seq_inicial, sttl)          teardown(enviados, retransmitidos)
+//   tx(seq, bytes, rótulo)                rx(seq, bytes, flags)
+//   retransmit(seq, bytes, tlp)           ack__advance(acknum, liberados, janela_remota)
+//   window__stall(em_voo, janela_remota)  window__open(duração_µs)
+//   reassembly__complete(fid, fragmentos, bytes)
+#ifndef SLOW_USDT
+#define SLOW_USDT 1
+#endif
+
+#if SLOW_USDT && __has_include(<sys/sdt.h>)
+#include <sys/sdt.h> // Para DTRACE_PROBEn.
+#define SLOW_PROBES_ENABLED 1
+#define SLOW_PROBE1(name, a)             DTRACE_PROBE1(slow, name, a)
+#define SLOW_PROBE2(name, a, b)          DTRACE_PROBE2(slow, name, a, b)
+#define SLOW_PROBE3(name, a, b, c)       DTRACE_PROBE3(slow, name, a, b, c)
+#else
+#define SLOW_PROBES_ENABLED 0
+#define SLOW_PROBE1(name, a)             do { (void)sizeof(a); } while (0)
+#define SLOW_PROBE2(name, a, b)          do { (void)sizeof(a); (void)sizeof(b); } while (0)
+#define SLOW_PROBE3(name, a, b, c)       do { (void)sizeof(a); (void)sizeof(b); (void)sizeof(c); } while (0)
+#endif
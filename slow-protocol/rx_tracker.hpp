@@ -0,0 +1,63 @@
+#pragma once
+//
+//  rx_tracker.hpp  –  Rastreamento dos seqnums recebidos do central
+// Este arquivo define o RxTracker, que mantém o maior seqnum contíguo já
+// recebido (base do ACK cumulativo) e um bitmap dos pacotes que chegaram
+// fora de ordem logo acima dele. Com isso a sessão descarta duplicatas e
+// nunca confirma um seqnum cujo antecessor ainda não chegou.
+#include "slow_packet.hpp" // Para seq_gt (aritmética de números de série).
+#include <bitset>  // Para std::bitset, o mapa de pacotes fora de ordem.
+#include <cstdint> // Para tipos inteiros de largura fixa.
+
+namespace slow {
+
+class RxTracker {
+public:
+    // Quantos seqnums acima do contíguo podem ser lembrados.
+    static constexpr uint32_t WINDOW = 256;
+
+    enum class Result : uint8_t {
+        InOrder,     // Exatamente o próximo esperado: o contíguo avançou.
+        OutOfOrder,  // Novo, mas há lacuna antes dele: fica marcado no bitmap.
+        Duplicate,   // Já recebido antes (abaixo do contíguo ou já marcado).
+        OutOfWindow  // Muito à frente para ser lembrado: deve ser descartado.
+    };
+
+    // Define o último seqnum contíguo conhecido e esquece o bitmap.
+    void reset(uint32_t cum) { cum_ = cum; bits_.reset(); }
+
+    uint32_t cumulative() const { return cum_; }
+    // Há pacotes guardados acima de uma lacuna?
+    bool     has_gap()    const { return bits_.any(); }
+
+    // Registra um pacote de dados com seqnum `s`.
+    Result accept(uint32_t s) {
+        if (!seq_gt(s, cum_))          return Result::Duplicate;
+        uint32_t d = s - cum_; // Distância módulo 2^32.
+        if (d > WINDOW)                return Result::OutOfWindow;
+        if (bits_.test(d - 1))         return Result::Duplicate;
+        if (d > 1) { bits_.set(d - 1); return Result::OutOfOrder; }
+        // Chegou o próximo esperado: avança por ele e por tudo que já estava guardado.
+        ++cum_;
+        bits_ >>= 1;
+        while (bits_.test(0)) { ++cum_; bits_ >>= 1; }
+        return Result::InOrder;
+    }
+
+    // Avança o contíguo até `s` sem exigir os intermediários (pacotes de
+    // controle). Nunca recua.
+    void advance_to(uint32_t s) {
+        if (!seq_gt(s, cum_)) return;
+        uint32_t d = s - cum_;
+        if (d >= WINDOW) bits_.reset();
+        else             bits_ >>= d;
+        cum_ = s;
+        while (bits_.test(0)) { ++cum_; bits_ >>= 1; }
+    }
+
+private:
+    uint32_t cum_ = 0;
+    std::bitset<WINDOW> bits_; // bit i ⇒ seqnum cum_ + 1 + i já recebido.
+};
+
+} // namespace slow
@@ -0,0 +1,74 @@
+#pragma once
+//
+//  series.hpp  –  Série temporal da conexão SLOW (CSV) para ajuste fino
+// Este arquivo define o SeriesRecorder, que grava uma linha CSV por amostra
+// com RTT, SRTT/RTTVAR, RTO, bytes em voo e as janelas remota e local. As
+// amostras são tiradas a cada ACK recebido ou em intervalo fixo; o arquivo
+// abre direto em planilhas, pandas ou gnuplot.
+#include <chrono>  // Para o intervalo entre amostras e o instante de cada uma.
+#include <cstdint> // Para tipos inteiros de largura fixa.
+#include <cstdio>  // Para FILE*, fopen e fprintf.
+
+namespace slow {
+
+// Uma amostra. RTT e SRTT/RTTVAR valem -1 enquanto não houver medição.
+struct SeriesPoint {
+    int64_t  rtt_us = -1, srtt_us = -1, rttvar_us = -1;
+    int      rto_ms = 0;          // RTO configurado (--rto).
+    uint32_t in_flight     = 0;   // Payload enviado e ainda não confirmado.
+    uint32_t remote_window = 0;   // Última janela anunciada pelo central (escalada).
+    uint32_t local_window  = 0;   // Espaço livre na nossa janela de recepção.
+    uint64_t retx          = 0;   // Retransmissões acumuladas.
+};
+
+class SeriesRecorder {
+public:
+    using clock = std::chrono::steady_clock;
+
+    SeriesRecorder() = default;
+    ~SeriesRecorder() { close(); }
+    SeriesRecorder(const SeriesRecorder&)            = delete;
+    SeriesRecorder& operator=(const SeriesRecorder&) = delete;
+
+    // `interval_ms` = 0 amostra a cada ACK; > 0, em intervalo fixo.
+    bool open(const char* path, int interval_ms) {
+        close();
+        f_ = std::fopen(path, "w");
+        if (!f_) return false;
+        std::setvbuf(f_, nullptr, _IOFBF, 1 << 16);
+        interval_ = std::chrono::milliseconds(interval_ms > 0 ? interval_ms : 0);
+        t0_ = next_ = clock::now();
+        // rto_calc_ms: o que um RTO adaptativo (SRTT + 4·RTTVAR) usaria.
+        std::fprintf(f_, "t_ms,rtt_ms,srtt_ms,rttvar_ms,rto_ms,rto_calc_ms,"
+                         "in_flight,remote_window,local_window,retx\n");
+        return true;
+    }
+    void close() {
+        if (f_) std::fclose(f_);
+        f_ = nullptr;
+    }
+    bool active()   const { return f_ != nullptr; }
+    bool per_ack()  const { return interval_.count() == 0; }
+    // Modo de intervalo: já passou da hora da próxima amostra?
+    bool due(clock::time_point now) const { return !per_ack() && now >= next_; }
+
+    void write(const SeriesPoint& p, clock::time_point now) {
+        if (!f_) return;
+        if (!per_ack())
+            while (next_ <= now) next_ += interval_;
+        auto ms = [](int64_t us) { return us < 0 ? -1.0 : us / 1000.0; };
+        double rto_calc = p.srtt_us < 0 ? -1.0 : (p.srtt_us + 4 * p.rttvar_us) / 1000.0;
+        std::fprintf(f_, "%.3f,%.3f,%.3f,%.3f,%d,%.3f,%u,%u,%u,%llu\n",
+                     std::chrono::duration<double, std::milli>(now - t0_).count(),
+                     ms(p.rtt_us), ms(p.srtt_us), ms(p.rttvar_us), p.rto_ms, rto_calc,
+                     p.in_flight, p.remote_window, p.local_window,
+                     static_cast<unsigned long long>(p.retx));
+    }
+
+private:
+    std::FILE* f_ = nullptr;
+    std::chrono::milliseconds interval_{0};
+    clock::time_point t0_{}, next_{};
+};
+
+} // namespace slow
@@ -5,35 +5,71 @@
 // Este arquivo define a classe Session, que gerencia o estado de uma
 // conexão SLOW, incluindo controle de fluxo com janelas deslizantes,
 // retransmissão e fragmentação de dados.
-/
+//
 #include "slow_packet.hpp" // Inclui as definições de Packet e UUID.
+#include "buffer_pool.hpp" // Inclui o pool de buffers MTU (BufferPool, PacketBuf).
+#include "tx_queue.hpp"    // Inclui a fila de transmissão em layout SoA.
+#include "rx_tracker.hpp"  // Inclui o rastreador de seqnums recebidos (ACK cumulativo).
+#include "histogram.hpp"   // Inclui o histograma de latências (RTT e mensagens).
+#include "msg_trace.hpp"   // Inclui o rastreio do ciclo de vida das mensagens.
+#include "probes.hpp"      // Inclui os tracepoints USDT (SLOW_PROBEn).
 #include <algorithm>       // Para std::min.
 #include <chrono>          // Para medição de tempo (timeouts, timestamps).
 #include <cstdint>         // Para tipos inteiros de largura fixa.
-#include <deque>           // Para std::deque, usado na fila de transmissão.
+#include <ostream>         // Para imprimir as estatísticas.
+#include <vector>          // Para std::vector, usado na lista de slots prontos.
 
 namespace slow {
 
-    // Estrutura que representa um pacote na fila de saída (Outbound Queue).
-struct Outbound {
-    Packet pkt; // O pacote SLOW a ser enviado.
-    std::chrono::steady_clock::time_point first_sent{}; // Timestamp da primeira vez que o pacote foi enviado.
-    std::chrono::steady_clock::time_point last_sent{};  // Timestamp da última vez que o pacote foi enviado (para RTO).
+// ───────────────────── Estatísticas da sessão ─────────────────────
+// Contadores acumulados desde o início da sessão. Pacotes e bytes contam
+// datagramas inteiros (cabeçalho incluso); "sent" inclui as retransmissões
+// e os pacotes de controle, "retx" é só a parte retransmitida.
+struct SessionStats {
+    uint64_t packets_sent = 0, bytes_sent = 0;
+    uint64_t packets_retx = 0, bytes_retx = 0;
+    uint64_t packets_rcvd = 0, bytes_rcvd = 0;
+    uint64_t rx_malformed = 0;  // Datagramas de dados descartados por serem curtos demais.
+    uint64_t dup_acks     = 0;  // ACKs que não avançaram a fila com dados em voo.
+    uint64_t rto_fires    = 0;  // Retransmissões por timeout (ou forçadas por NACK).
+    uint64_t tail_probes  = 0;  // Retransmissões por tail loss probe.
+    uint64_t window_stall_us = 0; // Tempo com dados na fila barrados pela janela remota.
+    uint64_t frags_queued = 0;  // Fragmentos criados por queue_data.
+    uint64_t frags_reassembled = 0, msgs_reassembled = 0;
+    uint64_t fec_recovered = 0; // Fragmentos reconstruídos por paridade.
+    int64_t  srtt_us = -1, rttvar_us = -1; // Estimativa atual de RTT (-1 = sem amostra).
+    uint64_t in_flight = 0;     // Bytes de payload enviados e ainda não confirmados.
 };
 
+inline std::ostream& operator<<(std::ostream& os, const SessionStats& s) {
+    os << "enviados   : " << s.packets_sent << " pkts, " << s.bytes_sent << " B\n"
+       << "retransm.  : " << s.packets_retx << " pkts, " << s.bytes_retx << " B"
+       << " (RTO " << s.rto_fires << ", TLP " << s.tail_probes << ")\n"
+       << "recebidos  : " << s.packets_rcvd << " pkts, " << s.bytes_rcvd << " B"
+       << " (" << s.rx_malformed << " descartados)\n"
+       << "ACKs dup.  : " << s.dup_acks << '\n'
+       << "janela     : " << s.window_stall_us / 1000 << " ms travada\n"
+       << "fragmentos : " << s.frags_queued << " enfileirados, " << s.frags_reassembled
+       << " remontados em " << s.msgs_reassembled << " msgs (" << s.fec_recovered << " por FEC)\n"
+       << "RTT        : ";
+    if (s.srtt_us < 0) os << "sem amostra\n";
+    else os << s.srtt_us / 1000.0 << " ms (var " << s.rttvar_us / 1000.0 << " ms)\n";
+    return os;
+}
+
 // Classe Session: Gerencia o estado de uma conexão SLOW.
 class Session {
 public:
 // Construtor: Inicializa a sessão com uma janela local padrão.
-    explicit Session(uint16_t local_window = 65535)
+    explicit Session(uint32_t local_window = 65535)
         : sid_{},
           sttl_ms_(0),
           next_seq_(0),
           last_ack_rcvd_(0),
           local_window_(local_window),
+          local_window_max_(local_window),
           window_remote_(0),
-          next_fid_(1),
-          last_rx_seq_(0) {}
+          next_fid_(1) {}
 
     /*──── fase de SETUP ou REVIVE ────*/
      // Estabelece ou revive uma sessão com base nos parâmetros de um pacote SETUP.
@@ -42,11 +78,15 @@ public:
         sttl_ms_      = setup.sttl;        // Copia o Session Time To Live.
         // O próximo número de sequência local é o `seqnum` do pacote SETUP + 1.
         next_seq_     = setup.seqnum + 1;
-        window_remote_= setup.window;      // Define a janela remota.
+        window_remote_= setup.window;      // Define a janela remota (nunca escalada no SETUP).
         // O último ACK recebido é o `acknum` do pacote SETUP.
         last_ack_rcvd_ = setup.acknum;
         // Registra o tempo de início da sessão.
         start_        = std::chrono::steady_clock::now();
+        last_progress_ = start_;
+        snd_max_      = next_seq_ - 1;     // Nada acima disso foi enviado ainda.
+        rebuild_header_template();
+        SLOW_PROBE2(establish, next_seq_, sttl_ms_);
     }
 
     /*──── utilidades ────*/
@@ -56,24 +96,86 @@ public:
     uint32_t peek_next_seq()   const { return next_seq_;   }
     // Retorna o último ACK recebido.
     uint32_t last_ack()       const  { return last_ack_rcvd_; }
-    // Retorna o espaço restante na janela de recepção local.
-    uint16_t local_window_left()const{ return local_window_;  }
+    // Retorna o espaço restante na janela de recepção local (em bytes).
+    uint32_t local_window_left()const{ return local_window_;  }
+    // Última janela anunciada pelo central (em bytes, já escalada).
+    uint32_t remote_window()  const  { return window_remote_; }
+    // Bytes de payload enviados e ainda não confirmados.
+    uint32_t in_flight() const;
+    // Última amostra de RTT, SRTT e RTTVAR em µs (-1 enquanto não houver amostra).
+    int64_t  last_rtt_us()    const  { return have_rtt_ ? last_rtt_us_ : -1; }
+    int64_t  srtt_us()        const  { return have_rtt_ ? srtt_us_ : -1; }
+    int64_t  rttvar_us()      const  { return have_rtt_ ? rttvar_us_ : -1; }
+    uint64_t retransmits()    const  { return stats_.packets_retx; }
+    // Valor do campo `window` a anunciar: a janela local deslocada pelo nosso wscale.
+    uint16_t advertised_window()const{
+        return static_cast<uint16_t>(std::min<uint32_t>(65535u, local_window_ >> rcv_wscale_));
+    }
     // Retorna o Session ID.
     const UUID& sid()         const  { return sid_; }
     // Retorna o Session Time To Live.
     uint32_t  sttl()          const  { return sttl_ms_; }
 
 
+    /*──── codificação a partir do template ────*/
+    // Escreve em `out` (até MTU_BUF bytes) um pacote de controle desta sessão,
+    // opcionalmente com um payload (pacotes de extensão). Retorna o tamanho.
+    size_t encode_control(uint8_t* out, uint8_t flags, uint32_t seqnum,
+                          uint32_t acknum, uint16_t window,
+                          const uint8_t* data = nullptr, size_t len = 0) const {
+        Packet::stamp_header(out, hdr_tmpl_.data(), flags, seqnum, acknum, window, 0, 0);
+        std::copy(data, data + len, out + Packet::HDR_SIZE);
+        return Packet::HDR_SIZE + len;
+    }
+
     /*──── SEQ do central recebido ────*/
-    // Registra o último número de sequência de pacote de dados recebido do peer.
-    // Usado para gerar ACKs.
+    // Registra um seqnum de referência (SETUP ou estado salvo do revive).
+    // O primeiro define a base; os seguintes só fazem o contíguo avançar.
     void note_rx_seq(uint32_t s) {
-        if (s != 0)
-            last_rx_seq_ = s;
+        if (s == 0) return;
+        if (!rx_started_) { rx_.reset(s); rx_started_ = true; }
+        else              rx_.advance_to(s);
+    }
+    // Registra o seqnum de um pacote de dados: detecta duplicatas e lacunas.
+    RxTracker::Result note_data_seq(uint32_t s) {
+        if (!rx_started_) { rx_.reset(s - 1); rx_started_ = true; }
+        return rx_.accept(s);
+    }
+    // Maior seqnum recebido sem lacunas: é o que os ACKs confirmam.
+    uint32_t last_rx_seq() const   { return rx_.cumulative(); }
+    // Há pacotes recebidos fora de ordem aguardando o preenchimento de uma lacuna?
+    bool rx_has_gap() const        { return rx_.has_gap(); }
+
+    void set_remote_window(uint16_t w) { window_remote_ = static_cast<uint32_t>(w) << snd_wscale_; }
+
+    /*──── window scaling ────*/
+    // Ativa a escala de janela negociada no CONNECT/SETUP: `remote_shift` é o
+    // wscale anunciado pelo central (aplicado às janelas que ele envia) e
+    // `local_shift` é o nosso (aplicado às janelas que anunciamos). A janela
+    // local passa a ter até 65535 << local_shift bytes.
+    void set_window_scale(uint8_t remote_shift, uint8_t local_shift) {
+        snd_wscale_       = remote_shift;
+        rcv_wscale_       = local_shift;
+        local_window_max_ = 65535u << local_shift;
+        local_window_     = local_window_max_;
     }
-    uint32_t last_rx_seq() const   { return last_rx_seq_;  }
 
-    void set_remote_window(uint16_t w) { window_remote_ = w; }
+    /*──── ACK atrasado (delayed ACK) ────*/
+    // Política: confirma a cada `every` pacotes de dados ou após `delay_ms`,
+    // o que vier primeiro. `every = 1` reproduz um ACK por pacote.
+    void set_ack_policy(unsigned every, int delay_ms) {
+        ack_every_    = every ? every : 1;
+        ack_delay_ms_ = delay_ms;
+    }
+    // Registra um pacote de dados recebido que precisa ser confirmado.
+    // `urgent` força o ACK imediato (lacuna na sequência ou fim de mensagem).
+    void schedule_ack(bool urgent);
+    // Indica se o ACK pendente deve sair agora.
+    bool ack_due(std::chrono::steady_clock::time_point now) const;
+    // Milissegundos até o prazo do ACK pendente (-1 se não há ACK pendente).
+    int  ack_wait_ms(std::chrono::steady_clock::time_point now) const;
+    // Deve ser chamado sempre que um pacote levando o acknum atual sair.
+    void ack_sent() { acks_pending_ = 0; ack_urgent_ = false; }
 
     void consume_local_window(size_t n);
     void release_local_window(size_t n);
@@ -87,156 +189,625 @@ public:
      // Lida com o recebimento de um pacote ACK.
     // Atualiza o last_ack_rcvd, a janela remota e o STTL.
     // Remove pacotes da fila de transmissão que foram reconhecidos.
-    void handle_ack(uint32_t acknum, uint16_t win_remote, uint32_t new_sttl);
+    // `tsecr` é o timestamp ecoado pelo central (0 se não veio nenhum).
+    void handle_ack(uint32_t acknum, uint16_t win_remote, uint32_t new_sttl,
+                    uint32_t tsecr = 0);
+
+    /*──── timestamps (eco de RTT) ────*/
+    // Ativado quando os dois lados anunciaram OPT_TSTAMP no handshake.
+    void set_timestamps(bool on)    { ts_ = on; }
+    bool timestamps_enabled() const { return ts_; }
+    // Relógio local em µs desde o início da sessão (módulo 2^32, nunca 0).
+    uint32_t ts_now() const {
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start_).count();
+        return static_cast<uint32_t>(us) | 1u;
+    }
+    // Registra o tsval de um pacote novo do central: é o que ecoamos em tsecr.
+    void note_ts(uint32_t tsval)    { ts_recent_ = tsval; }
+    uint32_t ts_recent() const      { return ts_recent_; }
+    // Onde os bytes da mensagem começam num datagrama de dados recebido.
+    size_t data_offset() const      { return Packet::HDR_SIZE + (ts_ ? Timestamps::LEN : 0); }
+    // Datagrama de dados curto demais para o prefixo de timestamps (malformado,
+    // ou de um par que não o põe): retorna false e conta o descarte.
+    bool accept_data_len(size_t len) {
+        if (len >= data_offset()) return true;
+        ++stats_.rx_malformed;
+        return false;
+    }
+
+    /*──── NACK ────*/
+    // Ativado quando os dois lados anunciaram OPT_NACK no handshake.
+    void set_nack(bool on)      { nack_ = on; }
+    bool nack_enabled() const   { return nack_; }
+    // Trata um pacote EXT_NACK: os fragmentos (fid, fo) listados que já foram
+    // enviados têm o timeout forçado e saem no próximo ready_to_send.
+    // Retorna quantos pacotes foram marcados.
+    size_t handle_nack(const Payload& nack);
+
+    /*──── FEC (paridade XOR) ────*/
+    // Ativado quando os dois lados anunciaram OPT_FEC no handshake: cada grupo
+    // de `n` fragmentos de uma mensagem ganha `k` (≤ n) pacotes EXT_PARITY.
+    void set_fec(uint8_t n, uint8_t k) {
+        fec_n_ = n;
+        fec_k_ = std::min(k, n);
+    }
+    bool fec_enabled() const    { return fec_n_ != 0; }
+    bool extensions_enabled() const { return nack_ || fec_enabled() || ts_; }
+    // Próxima paridade a enviar, já com seqnum/acknum/window atuais, ou nullptr.
+    // Uma paridade fica retida até o último fragmento do seu grupo sair e é
+    // descartada se o grupo já foi confirmado. Paridades não consomem seqnum,
+    // não ocupam a janela remota e nunca são retransmitidas.
+    const PacketBuf* next_parity();
+    // Remove a paridade devolvida por next_parity (ela também leva o acknum atual).
+    void parity_sent() {
+        note_tx_ctl(fec_q_[fec_head_].wire.size());
+        drop_parity();
+        ack_sent();
+    }
+
+    /*──── persist timer (janela zero) ────*/
+    // Há dados esperando, nada em voo e o próximo pacote não cabe na janela
+    // remota: só uma atualização de janela destrava a sessão. Se ela se perder,
+    // uma sonda periódica (com backoff exponencial a partir de `rto_ms`) força
+    // o central a reanunciar a janela. Retorna true quando a sonda deve sair.
+    bool persist_probe_due(int rto_ms, std::chrono::steady_clock::time_point now);
+    // Milissegundos até a próxima sonda (-1 se o persist timer está desarmado).
+    int  persist_wait_ms(std::chrono::steady_clock::time_point now) const;
+
+    /*──── RTT e tail loss probe ────*/
+    // SRTT (RFC 6298) em ms, medido pelo eco de timestamps quando negociado ou,
+    // sem ele, pelos ACKs de pacotes nunca retransmitidos (regra de Karn).
+    // -1 enquanto não há amostra.
+    int  srtt_ms() const { return have_rtt_ ? static_cast<int>(srtt_us_ / 1000) : -1; }
+    // Milissegundos até o tail loss probe poder disparar (-1 se não está armado).
+    int  tlp_wait_ms(int rto_ms, std::chrono::steady_clock::time_point now) const;
+    // Indica se o slot foi escolhido como tail loss probe no último ready_to_send.
+    bool is_tail_probe(size_t slot) const { return slot == tlp_slot_; }
 
     /*──── agendamento de envio ────*/
-    // Retorna um vetor de ponteiros para pacotes na fila que estão prontos para serem enviados/retransmitidos.
+    // Preenche `out` com os slots da fila que estão prontos para serem enviados/retransmitidos.
     // `rto_ms` é o valor do Retransmission Timeout em milissegundos.
-    std::vector<Outbound*> ready_to_send(int rto_ms);
-    void mark_sent(Outbound* o) { o->last_sent = std::chrono::steady_clock::now(); }
+    // `out` é reaproveitado entre chamadas para não realocar.
+    void ready_to_send(int rto_ms, std::vector<size_t>& out);
+    // Atualiza acknum/window (e os timestamps) na imagem serializada e a devolve
+    // pronta para o envio.
+    const PacketBuf& prepare_tx(size_t slot);
+    // Registra o envio. Como todo pacote da fila leva FLAG_ACK com o acknum
+    // atual (remendado em prepare_tx), ele também quita o ACK pendente.
+    void mark_sent(size_t slot) {
+        size_t bytes = txq_.wire(slot).size();
+        auto   now   = std::chrono::steady_clock::now();
+        ++stats_.packets_sent;
+        stats_.bytes_sent += bytes;
+        if (txq_.sent(slot)) {
+            ++stats_.packets_retx; stats_.bytes_retx += bytes;
+            SLOW_PROBE3(retransmit, txq_.seq(slot), bytes, static_cast<int>(slot == tlp_slot_));
+        }
+        if (mtrace_) mtrace_->sent(txq_.seq(slot), txq_.sent(slot), slot == tlp_slot_, now);
+        txq_.mark_sent(slot, now);
+        if (seq_gt(txq_.seq(slot), snd_max_)) snd_max_ = txq_.seq(slot);
+        if (txq_.flags(slot) & FLAG_ACK) ack_sent();
+    }
+    bool was_sent(size_t slot) const { return txq_.sent(slot); }
+    uint8_t tx_flags(size_t slot) const { return txq_.flags(slot); }
+    uint32_t tx_seq(size_t slot) const  { return txq_.seq(slot); }
     bool empty() const          { return txq_.empty(); }
 
+    // Pool de buffers MTU da sessão (também usado pelo caminho de RX).
+    BufferPool& pool()          { return pool_; }
+
+    /*──── estatísticas ────*/
+    // Eventos que só o laço de I/O enxerga.
+    void note_tx_ctl(size_t bytes)   { ++stats_.packets_sent; stats_.bytes_sent += bytes; }
+    void note_rx(size_t bytes)       { ++stats_.packets_rcvd; stats_.bytes_rcvd += bytes; }
+    void note_reassembled(size_t frags) { stats_.frags_reassembled += frags; ++stats_.msgs_reassembled; }
+    void note_fec_recovered()        { ++stats_.fec_recovered; }
+    // Cópia dos contadores, com RTT, bytes em voo e a trava de janela em curso.
+    SessionStats stats() const;
+    // Distribuições (em µs) de cada amostra de RTT e da latência de cada
+    // mensagem, de queue_data até o ACK do seu último fragmento.
+    const LatencyHistogram& rtt_histogram() const { return rtt_hist_; }
+    const LatencyHistogram& msg_histogram() const { return msg_hist_; }
+    // Rastreio opcional do ciclo de vida de cada mensagem (nullptr = desligado).
+    void set_msg_trace(MsgTrace* t) { mtrace_ = t; }
+
 private:
 // Calcula o espaço restante na janela de recepção remota.
     // Considera os pacotes que já estão "em voo" (enviados mas ainda não ACKed).
-    uint16_t window_remote_left() const;
+    uint32_t window_remote_left() const;
+    // Reconstrói o template de cabeçalho (sid + sttl) usado por todos os pacotes.
+    void rebuild_header_template();
+    // Incorpora uma amostra de RTT ao SRTT/RTTVAR.
+    void rtt_sample(std::chrono::microseconds r);
+    // Prazo do tail loss probe: PTO = max(2·SRTT, 10 ms) após o último envio
+    // da cauda ou o último progresso. Retorna o slot da cauda (ou NO_SLOT).
+    size_t tail_probe(int rto_ms, std::chrono::steady_clock::time_point& deadline) const;
+    // Serializa um pacote a partir do template da sessão direto em um buffer do pool.
+    PacketBuf encode(uint8_t flags, uint32_t seqnum, uint8_t fid, uint8_t fo,
+                     const uint8_t* data, size_t len);
+    // Gera as paridades dos `frags` fragmentos enfileirados a partir da
+    // posição lógica `first` da fila (todos da mensagem `fid`).
+    void queue_parity(uint8_t fid, size_t first, size_t frags);
+    // Descarta a paridade da frente da fila.
+    void drop_parity();
+    // Guarda o instante em que uma mensagem (terminada em `last_seq`) foi enfileirada.
+    void mark_message(uint32_t last_seq) {
+        if (msg_count_ == MSG_MARKS) { msg_head_ = (msg_head_ + 1) % MSG_MARKS; --msg_count_; }
+        msg_marks_[(msg_head_ + msg_count_++) % MSG_MARKS] = {last_seq, std::chrono::steady_clock::now()};
+    }
+    // Encerra a trava de janela em curso (se houver), somando sua duração.
+    void end_stall(std::chrono::steady_clock::time_point now) {
+        if (stall_since_.time_since_epoch().count() == 0) return;
+        if (mtrace_) mtrace_->stall(stall_since_, now);
+        uint64_t us = static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::microseconds>(now - stall_since_).count());
+        stats_.window_stall_us += us;
+        SLOW_PROBE1(window__open, us);
+        stall_since_ = {};
+    }
 
     UUID      sid_;
     uint32_t  sttl_ms_;
     uint32_t  next_seq_, last_ack_rcvd_;
-    uint16_t  local_window_, window_remote_;
+    uint32_t  local_window_, local_window_max_, window_remote_; // Em bytes (já escalados).
+    uint8_t   snd_wscale_ = 0, rcv_wscale_ = 0;
     uint8_t   next_fid_;
-    uint32_t  last_rx_seq_;
+    bool      nack_ = false;
+    uint8_t   fec_n_ = 0, fec_k_ = 0; // Grupo de N fragmentos, K paridades (0 = sem FEC).
+    uint32_t  snd_max_ = 0;           // Maior seqnum já enviado.
+    bool      ts_ = false;            // Timestamps negociados?
+    uint32_t  ts_recent_ = 0;         // Último tsval recebido do central.
+    RxTracker rx_;                   // Seqnums recebidos do central.
+    bool      rx_started_   = false;
+    unsigned  ack_every_    = 2;     // Confirma a cada N pacotes de dados...
+    int       ack_delay_ms_ = 40;    // ...ou após este atraso.
+    unsigned  acks_pending_ = 0;     // Pacotes de dados ainda não confirmados.
+    bool      ack_urgent_   = false;
+    std::chrono::steady_clock::time_point ack_deadline_{};
+    static constexpr int PERSIST_MAX_MS = 8000; // Teto do backoff das sondas.
+    int       persist_backoff_ms_ = 0;          // 0 = desarmado.
+    std::chrono::steady_clock::time_point persist_deadline_{};
+    static constexpr size_t NO_SLOT = static_cast<size_t>(-1);
+    static constexpr size_t MAX_FRAGS = 256; // fo de 8 bits: fragmentos por mensagem.
+    bool      have_rtt_  = false;
+    int64_t   srtt_us_   = 0, rttvar_us_ = 0, last_rtt_us_ = 0;
+    bool      tlp_done_  = false;   // Já houve um probe neste episódio sem progresso?
+    size_t    tlp_slot_  = NO_SLOT;
+    std::chrono::steady_clock::time_point last_progress_{}; // Último ACK que avançou a fila.
     std::chrono::steady_clock::time_point start_;
-    std::deque<Outbound> txq_;
+    std::array<uint8_t, Packet::HDR_SIZE> hdr_tmpl_{};
+    BufferPool pool_; // Declarado antes de txq_: os buffers voltam ao pool antes dele ser destruído.
+    TxQueue   txq_;
+    SessionStats stats_;
+    LatencyHistogram rtt_hist_, msg_hist_;
+    // Mensagens enfileiradas ainda não confirmadas: seqnum do último fragmento e
+    // instante do queue_data. Anel fixo; se encher, a mais antiga deixa de ser medida.
+    struct MsgMark { uint32_t last_seq; std::chrono::steady_clock::time_point queued; };
+    static constexpr size_t MSG_MARKS = 256;
+    std::array<MsgMark, MSG_MARKS> msg_marks_{};
+    size_t    msg_head_ = 0, msg_count_ = 0;
+    std::chrono::steady_clock::time_point stall_since_{}; // Início da trava de janela atual.
+    // Paridades aguardando o envio do último fragmento do grupo (`after`).
+    // Consumidas a partir de fec_head_; o vetor é esvaziado (sem perder a
+    // capacidade) quando todas saem.
+    struct PendingParity { uint32_t after; PacketBuf wire; };
+    std::vector<PendingParity> fec_q_;
+    MsgTrace* mtrace_ = nullptr;
+    size_t    fec_head_ = 0;
 };
 
 /*──────────────── IMPLEMENTAÇÃO ───────────────*/
 
+// sid e sttl são iguais para todos os pacotes da sessão: são codificados uma
+// vez aqui (com flags zeradas) e só voltam a ser tocados quando o sttl muda.
+inline void Session::rebuild_header_template() {
+    hdr_tmpl_.fill(0);
+    std::copy(sid_.bytes.begin(), sid_.bytes.end(), hdr_tmpl_.begin());
+    Packet::store32le(hdr_tmpl_.data() + Packet::OFF_FLAGS, (sttl_ms_ & 0x07FFFFFFu) << 5);
+}
+
+// acknum e window (e o prefixo de timestamps, se houver dados) são gravados
+// aqui, mas remendados de novo em prepare_tx.
+inline PacketBuf Session::encode(uint8_t flags, uint32_t seqnum, uint8_t fid, uint8_t fo,
+                                 const uint8_t* data, size_t len) {
+    PacketBuf raw(pool_);
+    Packet::stamp_header(raw.data(), hdr_tmpl_.data(), flags, seqnum,
+                         last_rx_seq(), advertised_window(), fid, fo);
+    size_t pre = (ts_ && len) ? Timestamps::LEN : 0;
+    if (pre) Timestamps::write(raw.data() + Packet::HDR_SIZE, 0, 0);
+    std::copy(data, data + len, raw.data() + Packet::HDR_SIZE + pre);
+    raw.resize(Packet::HDR_SIZE + pre + len);
+    return raw;
+}
+
 inline void Session::consume_local_window(size_t n) {
-    local_window_ = (n > local_window_) ? 0 : static_cast<uint16_t>(local_window_ - n);
+    local_window_ = (n > local_window_) ? 0 : static_cast<uint32_t>(local_window_ - n);
 }
 inline void Session::release_local_window(size_t n) {
-    constexpr uint32_t LIM = 65535;
-    local_window_ = static_cast<uint16_t>(std::min<uint32_t>(LIM, local_window_ + n));
+    local_window_ = static_cast<uint32_t>(std::min<size_t>(local_window_max_, local_window_ + n));
+}
+
+inline uint32_t Session::in_flight() const {
+    uint32_t bytes = 0;
+    for (size_t i = 0; i < txq_.size(); ++i) {
+        size_t s = txq_.slot(i);
+        if (txq_.sent(s))
+            bytes += txq_.size_of(s);
+    }
+    return bytes;
 }
 
-inline uint16_t Session::window_remote_left() const {
-    size_t in_flight = 0;
-    for (const auto& o : txq_)
-        if (o.last_sent.time_since_epoch().count() != 0)
-            in_flight += o.pkt.data.size();
-    return window_remote_ > in_flight ? window_remote_ - in_flight : 0;
+inline uint32_t Session::window_remote_left() const {
+    uint32_t used = in_flight();
+    return window_remote_ > used ? window_remote_ - used : 0;
 }
 
 // Implementação para enfileirar dados e realizar fragmentação.
 inline void Session::queue_data(const std::vector<uint8_t>& payload, bool is_revive) {
-    constexpr size_t MAX_PAY = 1440;
+    // Com FEC, os fragmentos encolhem para que a paridade (cabeçalho + XOR) caiba no MTU.
+    // Com timestamps, cada fragmento também reserva espaço para o prefixo deles.
+    // Um fragmento também nunca é maior que a janela anunciada pelo central: se
+    // fosse, ready_to_send jamais o enviaria (nem com tudo confirmado) e as
+    // sondas do persist timer só trariam de volta a mesma janela. Com janela
+    // zero, o tamanho cheio é usado e o persist timer espera ela abrir. O fo
+    // tem 8 bits: se a janela exigir mais de 256 fragmentos, o tamanho cheio
+    // também é mantido (fo repetidos embaralhariam remontagem, NACK e FEC).
+    size_t MAX_PAY = (fec_enabled() ? Parity::MAX_DATA : Payload::CAPACITY) -
+                     (ts_ ? Timestamps::LEN : 0);
+    if (window_remote_ != 0 && window_remote_ < MAX_PAY &&
+        (payload.size() + window_remote_ - 1) / window_remote_ <= MAX_FRAGS)
+        MAX_PAY = window_remote_;
     size_t  off = 0;
     uint8_t fo = 0;
+    size_t  first = txq_.size();
+    uint32_t first_seq = next_seq_;
 
     // Caso especial: se o payload for vazio e for um pacote de REVIVE,
     // cria um pacote REVIVE/ACK puro (sem dados).
     if (payload.empty() && is_revive) {
-        Packet p;
-        p.sid    = sid_;
-        p.sttl   = sttl_ms_;
-        p.flags  = FLAG_REVIVE | FLAG_ACK;
-        p.seqnum = next_seq_++;
-        p.acknum = last_rx_seq_;
-        p.window = local_window_left();
-        txq_.push_back({p});
+        uint8_t  flags = FLAG_REVIVE | FLAG_ACK;
+        uint32_t seq   = next_seq_++;
+        txq_.push_back(seq, flags, 0, 0, 0, encode(flags, seq, 0, 0, nullptr, 0));
+        mark_message(seq);
+        if (mtrace_) mtrace_->queued(seq, seq, 0, 0, std::chrono::steady_clock::now());
         return;
     }
 
     // Loop para fragmentar e enfileirar o payload.
     while (off < payload.size()) {
-        size_t avail = window_remote_left();
-        // Se não há espaço disponível e a fila não está vazia (há pacotes em voo),
-        // não podemos enviar mais.
-        if (avail == 0 && !txq_.empty()) return;
-
-        // Calcula quantos bytes podem ser enviados neste fragmento:
-        // Mínimo entre: (se avail=0, MAX_PAY; senão avail), MAX_PAY, e bytes restantes do payload.
-        size_t here  = std::min({avail == 0 ? MAX_PAY : avail, MAX_PAY, payload.size() - off});
+        // Todo o payload é enfileirado em fragmentos de até MAX_PAY; quem respeita o
+        // espaço livre da janela remota é ready_to_send.
+        size_t here  = std::min(MAX_PAY, payload.size() - off);
 
-        Packet p;
-        p.sid    = sid_;
-        p.sttl   = sttl_ms_;
-        p.flags  = FLAG_ACK;
+        uint8_t flags = FLAG_ACK;
 
         // Se for um pacote de revive e este for o primeiro fragmento (off == 0),
         // adiciona a flag REVIVE.
 
         if (is_revive && off == 0) {
-            p.flags |= FLAG_REVIVE;
+            flags |= FLAG_REVIVE;
         }
 
-        p.seqnum = next_seq_++;
-        p.acknum = last_rx_seq_;
-        p.window = local_window_left();
+        uint32_t seq = next_seq_++;
 
         // Se o payload original foi fragmentado (tamanho > MAX_PAY), usa next_fid_.
         // Caso contrário (payload cabe em um único pacote), fid é 0.
         uint8_t fid = (payload.size() > MAX_PAY) ? next_fid_ : 0;
-        p.fid    = fid;
-        p.fo     = static_cast<uint8_t>(fo++);
         if (off + here < payload.size()) {
-            p.flags |= FLAG_MOREBITS;
+            flags |= FLAG_MOREBITS;
         }
 
-        p.data.assign(payload.begin() + off, payload.begin() + off + here);
-        txq_.push_back({p});
+        txq_.push_back(seq, flags, static_cast<uint16_t>(here), fid, fo,
+                       encode(flags, seq, fid, fo, payload.data() + off, here));
+        ++stats_.frags_queued;
+        ++fo;
         off += here;
     }
 
+    if (!payload.empty()) {
+        mark_message(next_seq_ - 1);
+        if (mtrace_)
+            mtrace_->queued(first_seq, next_seq_ - 1, payload.size() > MAX_PAY ? next_fid_ : 0,
+                            payload.size(), std::chrono::steady_clock::now());
+    }
+
     if (payload.size() > MAX_PAY) {
+        if (fec_enabled())
+            queue_parity(next_fid_, first, txq_.size() - first);
         next_fid_++;
     }
 }
 
+// Grupos de fec_n_ fragmentos consecutivos; a paridade j cobre os fragmentos
+// j, j+k, j+2k... do grupo. O XOR é feito sobre as imagens já serializadas.
+inline void Session::queue_parity(uint8_t fid, size_t first, size_t frags) {
+    for (size_t g = 0; g < frags; g += fec_n_) {
+        size_t n    = std::min<size_t>(fec_n_, frags - g);
+        size_t k    = std::min<size_t>(fec_k_, n);
+        size_t last = txq_.slot(first + g + n - 1);
+        bool   end  = !(txq_.flags(last) & FLAG_MOREBITS);
+        uint32_t seq0 = txq_.seq(txq_.slot(first + g));
+        for (size_t j = 0; j < k; ++j) {
+            PacketBuf raw(pool_);
+            Packet::stamp_header(raw.data(), hdr_tmpl_.data(), FLAG_ACK | FLAG_ACCEPT, 0,
+                                 last_rx_seq(), advertised_window(), fid,
+                                 static_cast<uint8_t>(g));
+            uint8_t* ext = raw.data() + Packet::HDR_SIZE;
+            uint8_t* x   = ext + Parity::HDR;
+            size_t   width   = 0;
+            uint16_t len_xor = 0;
+            for (size_t i = j; i < n; i += k) {
+                size_t s   = txq_.slot(first + g + i);
+                size_t len = txq_.wire(s).size() - Packet::HDR_SIZE; // Com o prefixo, se houver.
+                const uint8_t* d = txq_.wire(s).data() + Packet::HDR_SIZE;
+                if (len > width) { std::fill(x + width, x + len, uint8_t{0}); width = len; }
+                for (size_t b = 0; b < len; ++b) x[b] ^= d[b];
+                len_xor ^= static_cast<uint16_t>(len);
+            }
+            Parity::write_header(ext, static_cast<uint8_t>(n), static_cast<uint8_t>(k),
+                                 static_cast<uint8_t>(j), end, len_xor, seq0);
+            raw.resize(Packet::HDR_SIZE + Parity::HDR + width);
+            fec_q_.push_back({txq_.seq(last), std::move(raw)});
+        }
+    }
+}
+
+inline const PacketBuf* Session::next_parity() {
+    while (fec_head_ < fec_q_.size()) {
+        PendingParity& p = fec_q_[fec_head_];
+        if (seq_le(p.after, last_ack_rcvd_)) { drop_parity(); continue; } // Grupo já confirmado.
+        if (seq_gt(p.after, snd_max_)) return nullptr; // O grupo ainda não saiu inteiro.
+        Packet::patch_seqnum(p.wire.data(), last_rx_seq());
+        Packet::patch_ack_window(p.wire.data(), last_rx_seq(), advertised_window());
+        return &p.wire;
+    }
+    return nullptr;
+}
+
+inline void Session::drop_parity() {
+    fec_q_[fec_head_].wire.reset();
+    if (++fec_head_ == fec_q_.size()) { fec_q_.clear(); fec_head_ = 0; }
+}
+
+// O prazo é contado a partir do primeiro pacote não confirmado, para que um
+// fluxo contínuo não adie o ACK indefinidamente.
+inline void Session::schedule_ack(bool urgent) {
+    if (acks_pending_++ == 0)
+        ack_deadline_ = std::chrono::steady_clock::now() + std::chrono::milliseconds(ack_delay_ms_);
+    ack_urgent_ = ack_urgent_ || urgent;
+}
+
+inline bool Session::ack_due(std::chrono::steady_clock::time_point now) const {
+    if (acks_pending_ == 0) return false;
+    return ack_urgent_ || acks_pending_ >= ack_every_ || now >= ack_deadline_;
+}
+
+inline int Session::ack_wait_ms(std::chrono::steady_clock::time_point now) const {
+    if (acks_pending_ == 0) return -1;
+    if (ack_due(now)) return 0;
+    auto left = std::chrono::ceil<std::chrono::milliseconds>(ack_deadline_ - now);
+    return static_cast<int>(left.count());
+}
+
 // Implementação para lidar com ACKs recebidos.
-inline void Session::handle_ack(uint32_t acknum, uint16_t win_remote, uint32_t new_sttl) {
-    last_ack_rcvd_ = acknum;
-    window_remote_ = win_remote;
-    sttl_ms_       = new_sttl;
-    while (!txq_.empty() && txq_.front().pkt.seqnum <= acknum)
+inline void Session::handle_ack(uint32_t acknum, uint16_t win_remote, uint32_t new_sttl,
+                                uint32_t tsecr) {
+    uint32_t last_ack_before = last_ack_rcvd_;
+    // ACKs reordenados (mais antigos) não fazem o last_ack recuar nem trazem
+    // uma janela desatualizada.
+    if (seq_gt(acknum, last_ack_rcvd_))
+        last_ack_rcvd_ = acknum;
+    if (seq_ge(acknum, last_ack_before))
+        window_remote_ = static_cast<uint32_t>(win_remote) << snd_wscale_;
+    if (new_sttl != sttl_ms_) {
+        sttl_ms_ = new_sttl;
+        rebuild_header_template();
+    }
+    auto now        = std::chrono::steady_clock::now();
+    bool dup        = acknum == last_ack_before && !txq_.empty() && txq_.sent(txq_.front());
+    bool progressed = false;
+    bool newest_retx = false;
+    TxQueue::time_point newest_sent{};
+    uint32_t freed = 0;
+    while (!txq_.empty() && seq_le(txq_.seq(txq_.front()), acknum)) {
+        size_t s    = txq_.front();
+        ++freed;
+        newest_sent = txq_.first_sent(s);
+        newest_retx = txq_.first_sent(s) != txq_.last_sent(s);
         txq_.pop_front();
+        progressed  = true;
+    }
+    if (progressed) {
+        // Com timestamps, o eco identifica a transmissão que provocou o ACK (mesmo
+        // uma retransmissão). Sem eles, regra de Karn: amostra só o pacote mais
+        // novo confirmado, e só se nunca foi retransmitido.
+        // Um eco "do futuro" (diferença negativa) não é nosso: é descartado.
+        int32_t echoed = static_cast<int32_t>(ts_now() - tsecr);
+        if (ts_ && tsecr != 0 && echoed >= 0)
+            rtt_sample(std::chrono::microseconds(echoed));
+        else if (!newest_retx && newest_sent.time_since_epoch().count() != 0)
+            rtt_sample(std::chrono::duration_cast<std::chrono::microseconds>(now - newest_sent));
+        // Houve progresso: novo episódio para o tail loss probe.
+        last_progress_ = now;
+        tlp_done_      = false;
+        if (mtrace_) mtrace_->acked(acknum, now);
+        SLOW_PROBE3(ack__advance, acknum, freed, window_remote_);
+        // Mensagens cujo último fragmento foi confirmado: fecha a latência.
+        while (msg_count_ && seq_le(msg_marks_[msg_head_].last_seq, acknum)) {
+            msg_hist_.record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+                now - msg_marks_[msg_head_].queued).count()));
+            msg_head_ = (msg_head_ + 1) % MSG_MARKS;
+            --msg_count_;
+        }
+    } else if (dup) {
+        ++stats_.dup_acks;
+    }
+}
+
+inline size_t Session::handle_nack(const Payload& nack) {
+    size_t marked = 0;
+    for (size_t k = 0; k < Nack::count(nack); ++k) {
+        uint8_t fid = Nack::fid(nack, k), fo = Nack::fo(nack, k);
+        if (fid == 0) continue; // fid 0 = mensagem de um só pacote: ambíguo entre mensagens.
+        for (size_t i = 0; i < txq_.size(); ++i) {
+            size_t s = txq_.slot(i);
+            if (txq_.fid(s) == fid && txq_.fo(s) == fo && txq_.sent(s)) {
+                txq_.expire(s);
+                ++marked;
+                break;
+            }
+        }
+    }
+    return marked;
+}
+
+inline SessionStats Session::stats() const {
+    SessionStats s = stats_;
+    if (have_rtt_) { s.srtt_us = srtt_us_; s.rttvar_us = rttvar_us_; }
+    s.in_flight = in_flight();
+    if (stall_since_.time_since_epoch().count() != 0)
+        s.window_stall_us += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - stall_since_).count());
+    return s;
+}
+
+inline void Session::rtt_sample(std::chrono::microseconds r) {
+    int64_t us = r.count();
+    rtt_hist_.record(static_cast<uint64_t>(us));
+    last_rtt_us_ = us;
+    if (!have_rtt_) {
+        srtt_us_   = us;
+        rttvar_us_ = us / 2;
+        have_rtt_  = true;
+        return;
+    }
+    int64_t err = srtt_us_ > us ? srtt_us_ - us : us - srtt_us_;
+    rttvar_us_ = (3 * rttvar_us_ + err) / 4;
+    srtt_us_   = (7 * srtt_us_ + us) / 8;
+}
+
+// A cauda é o pacote mais novo já enviado. Se ele (ou o próprio ACK) se perder,
+// não haverá ACK duplicado algum para sinalizar a perda, então reenviá-lo após
+// ~2·SRTT de silêncio recupera a mensagem em cerca de um RTT em vez de um RTO.
+inline size_t Session::tail_probe(int rto_ms, std::chrono::steady_clock::time_point& deadline) const {
+    if (!have_rtt_ || tlp_done_ || txq_.empty()) return NO_SLOT;
+    auto pto = std::max(std::chrono::microseconds(2 * srtt_us_),
+                        std::chrono::microseconds(std::chrono::milliseconds(10)));
+    if (pto >= std::chrono::milliseconds(rto_ms)) return NO_SLOT; // O RTO chega antes.
+    for (size_t i = txq_.size(); i-- > 0;) {
+        size_t s = txq_.slot(i);
+        if (!txq_.sent(s)) continue;
+        deadline = std::max(txq_.last_sent(s), last_progress_) +
+                   std::chrono::duration_cast<std::chrono::steady_clock::duration>(pto);
+        return s;
+    }
+    return NO_SLOT;
+}
+
+inline int Session::tlp_wait_ms(int rto_ms, std::chrono::steady_clock::time_point now) const {
+    std::chrono::steady_clock::time_point deadline;
+    if (tail_probe(rto_ms, deadline) == NO_SLOT) return -1;
+    if (now >= deadline) return 0;
+    return static_cast<int>(std::chrono::ceil<std::chrono::milliseconds>(deadline - now).count());
+}
+
+inline bool Session::persist_probe_due(int rto_ms, std::chrono::steady_clock::time_point now) {
+    bool stalled = false;
+    if (!txq_.empty()) {
+        bool in_flight = false;
+        for (size_t i = 0; i < txq_.size() && !in_flight; ++i)
+            in_flight = txq_.sent(txq_.slot(i));
+        size_t head = txq_.front();
+        stalled = !in_flight && !(txq_.flags(head) & FLAG_REVIVE) &&
+                  txq_.size_of(head) > window_remote_left();
+    }
+    if (!stalled) { persist_backoff_ms_ = 0; return false; }
+
+    if (persist_backoff_ms_ == 0) { // Acabou de travar: arma o timer.
+        persist_backoff_ms_ = rto_ms;
+        persist_deadline_   = now + std::chrono::milliseconds(persist_backoff_ms_);
+        return false;
+    }
+    if (now < persist_deadline_) return false;
+    persist_backoff_ms_ = std::min(persist_backoff_ms_ * 2, PERSIST_MAX_MS);
+    persist_deadline_   = now + std::chrono::milliseconds(persist_backoff_ms_);
+    return true;
+}
+
+inline int Session::persist_wait_ms(std::chrono::steady_clock::time_point now) const {
+    if (persist_backoff_ms_ == 0) return -1;
+    if (now >= persist_deadline_) return 0;
+    return static_cast<int>(std::chrono::ceil<std::chrono::milliseconds>(persist_deadline_ - now).count());
+}
+
+// Antes de cada (re)envio, apenas os campos mutáveis são remendados na imagem
+// já serializada; o restante do datagrama é reaproveitado como está.
+inline const PacketBuf& Session::prepare_tx(size_t slot) {
+    PacketBuf& wire = txq_.wire(slot);
+    Packet::patch_ack_window(wire.data(), last_rx_seq(), advertised_window());
+    if (ts_ && txq_.size_of(slot) != 0)
+        Timestamps::write(wire.data() + Packet::HDR_SIZE, ts_now(), ts_recent_);
+    return wire;
 }
 
 // ▼▼▼ FUNÇÃO COM A CORREÇÃO FINAL ▼▼▼
 // Implementação para determinar quais pacotes estão prontos para serem enviados ou retransmitidos.
-inline std::vector<Outbound*> Session::ready_to_send(int rto_ms) {
-    std::vector<Outbound*> v;
+inline void Session::ready_to_send(int rto_ms, std::vector<size_t>& v) {
+    v.clear();
     size_t bytes_left = window_remote_left();
     auto   now        = std::chrono::steady_clock::now();
+    bool   blocked    = false; // Algum pacote ficou esperando pela janela remota?
 
 // Itera sobre a fila de transmissão.
-    for (auto& ob : txq_) {
-        bool never_sent = ob.first_sent.time_since_epoch().count() == 0;
-        bool timed_out  = !never_sent && (now - ob.last_sent) > std::chrono::milliseconds(rto_ms);
+    for (size_t i = 0; i < txq_.size(); ++i) {
+        size_t s = txq_.slot(i);
+        bool never_sent = !txq_.sent(s);
+        bool timed_out  = !never_sent && (now - txq_.last_sent(s)) > std::chrono::milliseconds(rto_ms);
 
         if (!never_sent && !timed_out) {
             continue; // Já foi enviado e ainda não deu timeout
         }
 // Verifica se é um pacote de REVIVE.
-        bool is_revive_packet = (ob.pkt.flags & FLAG_REVIVE);
+        bool is_revive_packet = (txq_.flags(s) & FLAG_REVIVE);
 
         // Um pacote pode ser enviado se:
         // 1. For o pacote de REVIVE (tem passe livre para abrir a conexão).
         // 2. Ou se ele couber na janela remota.
-        if (is_revive_packet || ob.pkt.data.size() <= bytes_left) {
-            v.push_back(&ob);
+        if (is_revive_packet || txq_.size_of(s) <= bytes_left) {
+            v.push_back(s);
+            if (timed_out) ++stats_.rto_fires;
             // Desconta da janela apenas se for um pacote de dados comum.
             if (!is_revive_packet) {
-                bytes_left -= ob.pkt.data.size();
+                bytes_left -= txq_.size_of(s);
             }
         } else {
             // Se um pacote de dados não couber na janela, paramos por aqui.
+            blocked = true;
             break;
         }
     }
-    return v;
+    // Tempo travado pela janela: conta enquanto houver dados esperando por ela.
+    if (!blocked)
+        end_stall(now);
+    else if (stall_since_.time_since_epoch().count() == 0) {
+        stall_since_ = now;
+        SLOW_PROBE2(window__stall, window_remote_ - std::min<size_t>(window_remote_, bytes_left), window_remote_);
+    }
+
+    // Tail loss probe: se nada mais vai sair agora, reenvia a cauda uma vez
+    // quando o PTO vence sem progresso nos ACKs.
+    tlp_slot_ = NO_SLOT;
+    std::chrono::steady_clock::time_point deadline;
+    if (v.empty()) {
+        size_t tail = tail_probe(rto_ms, deadline);
+        if (tail != NO_SLOT && now >= deadline) {
+            v.push_back(tail);
+            tlp_slot_ = tail;
+            tlp_done_ = true;
+            ++stats_.tail_probes;
+        }
+    }
 }
 
-} // namespace slow
\ No newline at end of file
+} // namespace slow
\ No newline at end of file
@@ -4,6 +4,7 @@
 // Este arquivo define as estruturas de dados fundamentais e utilidades
 // para o protocolo de rede SLOW, incluindo a definição de pacotes e
 // a lógica para serialização/desserialização.
+#include <algorithm> // Para std::copy e std::min.
 #include <array>     // Para std::array, usado no UUID.
 #include <cctype>    // Para std::isprint, usado na impressão de dados.
 #include <cstdint>   // Para tipos inteiros de largura fixa (uint8_t, uint16_t, uint32_t).
@@ -11,7 +12,8 @@
 #include <iomanip>   // Para std::setw e std::setfill, usados na formatação de saída.
 #include <iostream>  // Para std::ostream, usado na impressão.
 #include <stdexcept> // Para std::runtime_error, usado em validações.
-#include <vector>    // Para std::vector, usado para o payload do pacote.
+#include <type_traits> // Para std::is_trivially_copyable_v.
+#include <vector>    // Para std::vector, usado na serialização.
 
 namespace slow {
 
@@ -45,10 +47,82 @@ enum : uint8_t {
     FLAG_MOREBITS  = 1u << 0   // MB
 };
 
+// ─────────────── Aritmética de números de série ───────────────
+// Comparações de seqnum/acknum segundo a RFC 1982 (SERIAL_BITS = 32): `a` é
+// menor que `b` se estiver até 2^31 - 1 passos "atrás" dele, módulo 2^32.
+// Assim a ordem continua correta quando a sequência dá a volta em 2^32.
+// (A distância exata de 2^31 é indefinida na RFC; aqui conta como "maior".)
+constexpr bool seq_lt(uint32_t a, uint32_t b) {
+    return a != b && static_cast<uint32_t>(b - a) < 0x80000000u;
+}
+constexpr bool seq_le(uint32_t a, uint32_t b) { return a == b || seq_lt(a, b); }
+constexpr bool seq_gt(uint32_t a, uint32_t b) { return seq_lt(b, a); }
+constexpr bool seq_ge(uint32_t a, uint32_t b) { return a == b || seq_lt(b, a); }
+
+// Verificações em tempo de compilação, inclusive cruzando a fronteira de 2^32.
+static_assert(seq_lt(1u, 2u) && !seq_lt(2u, 1u) && !seq_lt(7u, 7u));
+static_assert(seq_lt(0xFFFFFFFFu, 0u) && seq_gt(0u, 0xFFFFFFFFu));
+static_assert(seq_lt(0xFFFFFFF0u, 0x10u) && seq_gt(0x10u, 0xFFFFFFF0u));
+static_assert(seq_le(0xFFFFFFFFu, 0xFFFFFFFFu) && seq_ge(0u, 0u));
+static_assert(seq_lt(0x7FFFFFFFu, 0xFFFFFFFEu) && seq_lt(0xFFFFFFFFu, 0x7FFFFFFEu));
+static_assert(uint32_t(0xFFFFFFFFu + 1u) == 0u && seq_gt(uint32_t(0xFFFFFFFFu + 1u), 0xFFFFFFFFu));
+
+// ────────────────────────── Payload ──────────────────────────
+// Payload de capacidade fixa (1440 B) guardado dentro do próprio Packet.
+// Evita uma alocação e uma indireção por pacote e mantém Packet
+// trivialmente copiável. Expõe a mesma interface de std::vector usada no projeto.
+class Payload {
+public:
+    static constexpr size_t CAPACITY = 1440;
+
+    size_t         size()  const { return len_; }
+    bool           empty() const { return len_ == 0; }
+    uint8_t*       data()        { return buf_.data(); }
+    const uint8_t* data()  const { return buf_.data(); }
+    uint8_t*       begin()       { return buf_.data(); }
+    const uint8_t* begin() const { return buf_.data(); }
+    uint8_t*       end()         { return buf_.data() + len_; }
+    const uint8_t* end()   const { return buf_.data() + len_; }
+    uint8_t  operator[](size_t i) const { return buf_[i]; }
+    uint8_t& operator[](size_t i)       { return buf_[i]; }
+
+    void clear() { len_ = 0; }
+    template <class It>
+    void append(It first, It last) {
+        size_t n = static_cast<size_t>(last - first);
+        if (len_ + n > CAPACITY)
+            throw std::runtime_error("payload > 1440 bytes");
+        std::copy(first, last, buf_.begin() + len_);
+        len_ = static_cast<uint16_t>(len_ + n);
+    }
+    template <class It>
+    void assign(It first, It last) {
+        size_t n = static_cast<size_t>(last - first);
+        if (n > CAPACITY)
+            throw std::runtime_error("payload > 1440 bytes");
+        std::copy(first, last, buf_.begin());
+        len_ = static_cast<uint16_t>(n);
+    }
+
+private:
+    uint16_t len_ = 0;
+    std::array<uint8_t, CAPACITY> buf_; // Não inicializado de propósito: só len_ bytes são válidos.
+};
+
 // ────────────────────────── Packet ──────────────────────────
 // Estrutura que representa um pacote do protocolo SLOW.
 // Contém o cabeçalho e o payload (dados).
 struct Packet {
+    // Tamanho fixo do cabeçalho e posição dos campos que mudam entre
+    // retransmissões (usados para "remendar" uma imagem já serializada).
+    static constexpr size_t HDR_SIZE   = 16 + 4 + 4 + 4 + 2 + 1 + 1;
+    static constexpr size_t OFF_FLAGS  = 16;
+    static constexpr size_t OFF_SEQNUM = 16 + 4;
+    static constexpr size_t OFF_ACKNUM = 16 + 4 + 4;
+    static constexpr size_t OFF_WINDOW = 16 + 4 + 4 + 4;
+    static constexpr size_t OFF_FID    = 16 + 4 + 4 + 4 + 2;
+    static constexpr size_t OFF_FO     = 16 + 4 + 4 + 4 + 2 + 1;
+
     UUID      sid;
     uint32_t  sttl   = 0;  // 27 bits
     uint8_t   flags  = 0;  // 5 bits
@@ -57,16 +131,13 @@ struct Packet {
     uint16_t  window = 0;
     uint8_t   fid    = 0;
     uint8_t   fo     = 0;
-    std::vector<uint8_t> data;  // ≤ 1440 B
+    Payload   data;  // ≤ 1440 B, inline
 
     // ───── serialização ─────────────────────────────────────
      // Converte a estrutura Packet em um vetor de bytes para transmissão pela rede.
     std::vector<uint8_t> serialize() const {
-        if (data.size() > 1440)
-            throw std::runtime_error("payload > 1440 bytes");
-
         std::vector<uint8_t> v;
-        v.reserve(16 + 4 + 4 + 4 + 2 + 1 + 1 + data.size());
+        v.reserve(HDR_SIZE + data.size());
 
         // sid
         v.insert(v.end(), sid.bytes.begin(), sid.bytes.end());
@@ -89,8 +160,7 @@ struct Packet {
     // ───── desserialização ──────────────────────────────────
      // Converte um array de bytes recebido da rede de volta para a estrutura Packet.
     static Packet deserialize(const uint8_t* buf, size_t len) {
-        constexpr size_t MIN = 16 + 4 + 4 + 4 + 2 + 1 + 1;
-        if (len < MIN) throw std::runtime_error("pacote curto");
+        if (len < HDR_SIZE) throw std::runtime_error("pacote curto");
 
         Packet p;
         std::memcpy(p.sid.bytes.data(), buf, 16);
@@ -111,6 +181,56 @@ struct Packet {
         return p; // Retorna o Packet desserializado.
     }
 
+    // ───── cabeçalho a partir de um template ───────────────
+    // Preenche os campos por pacote sobre uma cópia de um template que já
+    // contém sid e sttl (com flags zeradas). Sem desvios: só cópias e stores.
+    static void stamp_header(uint8_t* raw, const uint8_t* tmpl, uint8_t flags,
+                             uint32_t seqnum, uint32_t acknum, uint16_t window,
+                             uint8_t fid, uint8_t fo) {
+        std::memcpy(raw, tmpl, HDR_SIZE);
+        raw[OFF_FLAGS] |= static_cast<uint8_t>(flags & 0x1Fu);
+        store32le(raw + OFF_SEQNUM, seqnum);
+        store32le(raw + OFF_ACKNUM, acknum);
+        store16le(raw + OFF_WINDOW, window);
+        raw[OFF_FID] = fid;
+        raw[OFF_FO]  = fo;
+    }
+
+    // ───── remendo in-place ─────────────────────────────────
+    // Atualiza acknum e window diretamente em uma imagem já serializada,
+    // evitando reconstruir o datagrama inteiro a cada retransmissão.
+    static void patch_ack_window(uint8_t* raw, uint32_t acknum, uint16_t window) {
+        store32le(raw + OFF_ACKNUM, acknum);
+        store16le(raw + OFF_WINDOW, window);
+    }
+    // Atualiza o seqnum (pacotes de extensão levam o seqnum do momento do envio).
+    static void patch_seqnum(uint8_t* raw, uint32_t seqnum) {
+        store32le(raw + OFF_SEQNUM, seqnum);
+    }
+
+    // ───── inteiros little-endian em buffers crus ──────────
+    // Também usados pelos cabeçalhos dos pacotes de extensão.
+    static void store16le(uint8_t* p, uint16_t x) {
+        p[0] = static_cast<uint8_t>(x);
+        p[1] = static_cast<uint8_t>(x >> 8);
+    }
+    static void store32le(uint8_t* p, uint32_t x) {
+        p[0] = static_cast<uint8_t>(x);
+        p[1] = static_cast<uint8_t>(x >> 8);
+        p[2] = static_cast<uint8_t>(x >> 16);
+        p[3] = static_cast<uint8_t>(x >> 24);
+    }
+    static uint16_t read16le(const uint8_t* p) {
+        return static_cast<uint16_t>(p[0]) |
+               static_cast<uint16_t>(p[1]) << 8;
+    }
+    static uint32_t read32le(const uint8_t* p) {
+        return static_cast<uint32_t>(p[0])        |
+              (static_cast<uint32_t>(p[1]) << 8)  |
+              (static_cast<uint32_t>(p[2]) << 16) |
+              (static_cast<uint32_t>(p[3]) << 24);
+    }
+
 private:
  // Funções auxiliares para adicionar inteiros em formato little-endian a um vetor de bytes.
     static void append16le(std::vector<uint8_t>& v, uint16_t x) {
@@ -123,15 +243,64 @@ private:
         v.push_back(static_cast<uint8_t>(x >> 16));
         v.push_back(static_cast<uint8_t>(x >> 24));
     }
-    static uint16_t read16le(const uint8_t* p) {
-        return static_cast<uint16_t>(p[0]) |
-               static_cast<uint16_t>(p[1]) << 8;
+};
+
+static_assert(std::is_trivially_copyable_v<Packet>,
+              "Packet deve ser trivialmente copiável (payload inline)");
+
+// ───────────────────── Opções de handshake ─────────────────────
+// CONNECT e SETUP podem levar no payload uma lista de opções TLV
+// (tipo: 1 B, tamanho do valor: 1 B, valor). Cada lado só usa uma opção
+// se ela vier nos dois sentidos; um central que não as conhece responde
+// sem opções e a sessão segue com os valores padrão.
+enum : uint8_t {
+    OPT_WSCALE = 1,  // Deslocamento (0..14) aplicado às janelas anunciadas por quem envia.
+    OPT_NACK   = 2,  // Sem valor: quem envia entende pacotes de extensão EXT_NACK.
+    OPT_FEC    = 3,  // Sem valor: quem envia entende pacotes de extensão EXT_PARITY.
+    OPT_TSTAMP = 4   // Sem valor: os dois lados levam timestamps (ver Timestamps).
+};
+
+struct HandshakeOptions {
+    static constexpr uint8_t MAX_WSCALE = 14;
+
+    bool    has_wscale = false;
+    uint8_t wscale     = 0;
+    bool    has_nack   = false;
+    bool    has_fec    = false;
+    bool    has_tstamp = false;
+
+    bool empty() const { return !has_wscale && !has_nack && !has_fec && !has_tstamp; }
+
+    // Escreve as opções presentes no payload de um CONNECT/SETUP.
+    void encode(Payload& out) const {
+        uint8_t buf[9];
+        size_t  n = 0;
+        if (has_wscale) { buf[n++] = OPT_WSCALE; buf[n++] = 1; buf[n++] = wscale; }
+        if (has_nack)   { buf[n++] = OPT_NACK;   buf[n++] = 0; }
+        if (has_fec)    { buf[n++] = OPT_FEC;    buf[n++] = 0; }
+        if (has_tstamp) { buf[n++] = OPT_TSTAMP; buf[n++] = 0; }
+        out.assign(buf, buf + n);
     }
-    static uint32_t read32le(const uint8_t* p) {
-        return static_cast<uint32_t>(p[0])        |
-              (static_cast<uint32_t>(p[1]) << 8)  |
-              (static_cast<uint32_t>(p[2]) << 16) |
-              (static_cast<uint32_t>(p[3]) << 24);
+    // Lê as opções de um payload; tipos desconhecidos são pulados.
+    static HandshakeOptions parse(const Payload& in) {
+        HandshakeOptions o;
+        size_t i = 0;
+        while (i + 2 <= in.size()) {
+            uint8_t type = in[i], len = in[i + 1];
+            if (i + 2 + len > in.size()) break;
+            if (type == OPT_WSCALE && len == 1) {
+                o.has_wscale = true;
+                o.wscale     = std::min<uint8_t>(in[i + 2], MAX_WSCALE);
+            } else if (type == OPT_NACK && len == 0) {
+                o.has_nack = true;
+            } else if (type == OPT_FEC && len == 0) {
+                o.has_fec = true;
+            } else if (type == OPT_TSTAMP && len == 0) {
+                o.has_tstamp = true;
+            }
+            i += 2 + len;
+        }
+        return o;
     }
 };
 
@@ -175,4 +344,105 @@ inline std::ostream& operator<<(std::ostream& os, const Packet& p)
     return os;
 }
 
+// ───────────────────── Pacotes de extensão ─────────────────────
+// Depois do handshake, FLAG_ACCEPT não tem uso. Quando uma extensão foi
+// negociada, um pacote com FLAG_ACCEPT e payload é um pacote de extensão:
+// payload[0] diz o tipo. Ele não consome seqnum (seqnum = acknum, como um
+// ACK puro) e não entra na remontagem.
+enum : uint8_t {
+    EXT_NACK   = 1,  // Lista de pares (fid, fo) ausentes na remontagem.
+    EXT_PARITY = 2,  // XOR de um subconjunto dos fragmentos de uma mensagem (FEC).
+    EXT_TSTAMP = 3   // Só os timestamps: é o ACK puro quando OPT_TSTAMP foi negociado.
+};
+
+inline bool is_extension(const Packet& p) {
+    return (p.flags & FLAG_ACCEPT) && !(p.flags & FLAG_CONNECT) && !p.data.empty();
+}
+
+// NACK: [EXT_NACK, fid0, fo0, fid1, fo1, ...].
+struct Nack {
+    static constexpr size_t MAX_PAIRS = (Payload::CAPACITY - 1) / 2;
+
+    // Escreve em `out` o cabeçalho EXT_NACK; os pares são acrescentados com add().
+    static void begin(Payload& out) { uint8_t t = EXT_NACK; out.assign(&t, &t + 1); }
+    static bool add(Payload& out, uint8_t fid, uint8_t fo) {
+        if (out.size() + 2 > Payload::CAPACITY) return false;
+        uint8_t pair[2] = {fid, fo};
+        out.append(pair, pair + 2);
+        return true;
+    }
+    // Quantos pares há em um payload EXT_NACK, e o i-ésimo deles.
+    static size_t count(const Payload& in) { return in.size() > 1 ? (in.size() - 1) / 2 : 0; }
+    static uint8_t fid(const Payload& in, size_t i) { return in[1 + 2 * i]; }
+    static uint8_t fo (const Payload& in, size_t i) { return in[2 + 2 * i]; }
+};
+
+// Paridade (FEC): o cabeçalho do pacote leva o fid da mensagem e, em fo, o
+// primeiro fo do grupo de `n` fragmentos. A paridade `j` (de `k`) cobre os
+// fragmentos g+j, g+j+k, g+j+2k... do grupo; por ser intercalada, `k`
+// paridades recuperam uma rajada de até `k` fragmentos perdidos seguidos.
+// Payload: [EXT_PARITY, n, k, j, end, 0, len_xor (16 LE), seq0 (32 LE), xor...]
+//   end     = 1 se o grupo termina a mensagem (seu último fragmento não tem MB);
+//   len_xor = XOR dos tamanhos dos fragmentos cobertos;
+//   seq0    = seqnum do fragmento g (os fragmentos têm seqnums consecutivos);
+//   xor     = XOR dos payloads cobertos, cada um completado com zeros.
+struct Parity {
+    static constexpr size_t HDR = 12;
+    // Payload máximo de um fragmento quando a paridade precisa caber no MTU.
+    static constexpr size_t MAX_DATA = Payload::CAPACITY - HDR;
+
+    static void write_header(uint8_t* ext, uint8_t n, uint8_t k, uint8_t j, bool end,
+                             uint16_t len_xor, uint32_t seq0) {
+        ext[0] = EXT_PARITY; ext[1] = n; ext[2] = k; ext[3] = j;
+        ext[4] = end ? 1 : 0; ext[5] = 0;
+        Packet::store16le(ext + 6, len_xor);
+        Packet::store32le(ext + 8, seq0);
+    }
+    static bool     valid(const uint8_t* ext, size_t len) {
+        return len >= HDR && ext[0] == EXT_PARITY && ext[2] != 0 && ext[3] < ext[2];
+    }
+    static uint8_t  n      (const uint8_t* ext) { return ext[1]; }
+    static uint8_t  k      (const uint8_t* ext) { return ext[2]; }
+    static uint8_t  j      (const uint8_t* ext) { return ext[3]; }
+    static bool     end    (const uint8_t* ext) { return ext[4] != 0; }
+    static uint16_t len_xor(const uint8_t* ext) { return Packet::read16le(ext + 6); }
+    static uint32_t seq0   (const uint8_t* ext) { return Packet::read32le(ext + 8); }
+};
+
+// Timestamps (eco para medir o RTT): com OPT_TSTAMP negociado, todo pacote de
+// dados começa com [tsval (32 LE), tsecr (32 LE)] antes dos bytes da mensagem,
+// e o ACK puro vira um pacote de extensão [EXT_TSTAMP, tsval, tsecr]. tsval é
+// o relógio de quem envia (gravado a cada envio, inclusive retransmissões) e
+// tsecr repete o último tsval recebido do outro lado; 0 significa "sem eco".
+// Assim um ACK diz qual transmissão o provocou e toda confirmação vira uma
+// amostra de RTT, sem a ambiguidade que a regra de Karn descarta.
+struct Timestamps {
+    static constexpr size_t LEN = 8;
+
+    static void write(uint8_t* p, uint32_t tsval, uint32_t tsecr) {
+        Packet::store32le(p, tsval);
+        Packet::store32le(p + 4, tsecr);
+    }
+    // Payload de um EXT_TSTAMP.
+    static void ack(Payload& out, uint32_t tsval, uint32_t tsecr) {
+        uint8_t buf[1 + LEN] = {EXT_TSTAMP};
+        write(buf + 1, tsval, tsecr);
+        out.assign(buf, buf + sizeof(buf));
+    }
+    // Lê os timestamps do prefixo dos dados ou de um EXT_TSTAMP.
+    static bool read(const Packet& p, uint32_t& tsval, uint32_t& tsecr) {
+        const uint8_t* at;
+        if (is_extension(p)) {
+            if (p.data[0] != EXT_TSTAMP || p.data.size() < 1 + LEN) return false;
+            at = p.data.data() + 1;
+        } else {
+            if (p.data.size() < LEN) return false;
+            at = p.data.data();
+        }
+        tsval = Packet::read32le(at);
+        tsecr = Packet::read32le(at + 4);
+        return true;
+    }
+};
+
 } // namespace slow
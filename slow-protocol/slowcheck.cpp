@@ -0,0 +1,203 @@
+//
+//  slowcheck.cpp – verificações da sessão SLOW (make check)
+//
+
+// Este arquivo implementa um programa de verificação sem rede: monta sessões
+// e rastreadores diretamente e confere o comportamento nos casos de borda.
+// Cada CHECK que falha é impresso com a linha; o código de saída é 1 se
+// algum falhou.
+
+#include "session.hpp"  // Inclui Session, RxTracker e a aritmética de seqnums.
+#include <iostream>     // Para entrada/saída padrão.
+
+using namespace slow;
+
+static int failures = 0;
+#define CHECK(cond)                                                              \
+    do {                                                                         \
+        if (!(cond)) {                                                           \
+            std::cerr << "FALHOU " << __FILE__ << ":" << __LINE__ << ": " #cond "\n"; \
+            ++failures;                                                          \
+        }                                                                        \
+    } while (0)
+
+// SETUP sintético: o próximo seqnum local será `seq + 1`.
+static Packet setup_at(uint32_t seq, uint16_t window) {
+    Packet p{};
+    p.flags  = FLAG_ACCEPT;
+    p.seqnum = seq;
+    p.acknum = seq;
+    p.window = window;
+    p.sttl   = 5000;
+    return p;
+}
+
+/*──────── seqnums em torno de 2^32 ────────*/
+// RxTracker: contíguo, lacunas, duplicatas e advance_to atravessando o zero.
+static void rx_tracker_wrap() {
+    RxTracker rx;
+    rx.reset(0xFFFFFFFEu);
+    CHECK(rx.accept(0xFFFFFFFFu) == RxTracker::Result::InOrder);
+    CHECK(rx.cumulative() == 0xFFFFFFFFu);
+    CHECK(rx.accept(1) == RxTracker::Result::OutOfOrder);    // Falta o 0.
+    CHECK(rx.has_gap());
+    CHECK(rx.accept(0xFFFFFFFFu) == RxTracker::Result::Duplicate);
+    CHECK(rx.accept(1) == RxTracker::Result::Duplicate);
+    CHECK(rx.accept(0) == RxTracker::Result::InOrder);       // Fecha a lacuna: vai até 1.
+    CHECK(rx.cumulative() == 1);
+    CHECK(!rx.has_gap());
+    CHECK(rx.accept(1 + RxTracker::WINDOW + 1) == RxTracker::Result::OutOfWindow);
+
+    rx.reset(0xFFFFFFF0u);
+    CHECK(rx.accept(0xFFFFFFF3u) == RxTracker::Result::OutOfOrder);
+    rx.advance_to(0xFFFFFFF2u);                               // Puxa o 0xFFFFFFF3 guardado.
+    CHECK(rx.cumulative() == 0xFFFFFFF3u);
+    rx.advance_to(5);
+    CHECK(rx.cumulative() == 5);
+    rx.advance_to(0xFFFFFFFFu);                               // Mais antigo: não recua.
+    CHECK(rx.cumulative() == 5);
+}
+
+// Sessão cujos fragmentos atravessam 0xFFFFFFFF → 0: envio limitado pela
+// janela, ACKs cumulativos retirando da fila e ACKs antigos ignorados.
+static void session_wrap() {
+    Session sess;
+    sess.establish(setup_at(0xFFFFFFFDu, 3000));             // Próximo seqnum: 0xFFFFFFFE.
+    std::vector<uint8_t> msg(4 * Payload::CAPACITY, 'x');   // 4 fragmentos: FFFFFFFE, FFFFFFFF, 0, 1.
+    sess.queue_data(msg);
+    CHECK(sess.peek_next_seq() == 2);
+
+    std::vector<size_t> ready;
+    sess.ready_to_send(800, ready);
+    CHECK(ready.size() == 2);                                 // 2×1440 cabem em 3000; o 3º não.
+    CHECK(ready.size() == 2 && sess.tx_seq(ready[0]) == 0xFFFFFFFEu && sess.tx_seq(ready[1]) == 0xFFFFFFFFu);
+    for (size_t s : ready) { sess.prepare_tx(s); sess.mark_sent(s); }
+    CHECK(sess.in_flight() == 2 * Payload::CAPACITY);
+
+    sess.ready_to_send(800, ready);
+    CHECK(ready.empty());                                     // Janela cheia.
+
+    // ACK de 0xFFFFFFFF libera os dois primeiros; os seguintes (0 e 1) saem.
+    sess.handle_ack(0xFFFFFFFFu, 6000, 5000);
+    CHECK(sess.last_ack() == 0xFFFFFFFFu);
+    CHECK(sess.in_flight() == 0);
+    sess.ready_to_send(800, ready);
+    CHECK(ready.size() == 2 && sess.tx_seq(ready[0]) == 0 && sess.tx_seq(ready[1]) == 1);
+    for (size_t s : ready) { sess.prepare_tx(s); sess.mark_sent(s); }
+
+    // ACK reordenado (mais antigo que o último): não recua nem muda a janela.
+    sess.handle_ack(0xFFFFFFFEu, 100, 5000);
+    CHECK(sess.last_ack() == 0xFFFFFFFFu);
+    CHECK(sess.remote_window() == 6000);
+    CHECK(sess.in_flight() == 2 * Payload::CAPACITY);
+
+    // ACK depois do zero: esvazia a fila.
+    sess.handle_ack(1, 6000, 5000);
+    CHECK(sess.last_ack() == 1);
+    CHECK(sess.empty());
+}
+
+/*──────── template de cabeçalho ────────*/
+// Um ACK com outro sttl refaz o template: os pacotes seguintes levam o sid e
+// o sttl novos, com as flags de cada pacote intactas.
+static void header_template() {
+    Packet setup = setup_at(100, 3000);
+    setup.sid.bytes[0] = 0xAB;
+    setup.sid.bytes[15] = 0xCD;
+    Session sess;
+    sess.establish(setup);
+    sess.handle_ack(100, 3000, 0x07FFFFFFu);
+    uint8_t raw[Packet::HDR_SIZE];
+    CHECK(sess.encode_control(raw, FLAG_ACK | FLAG_ACCEPT, 7, 8, 9) == Packet::HDR_SIZE);
+    Packet p = Packet::deserialize(raw, sizeof(raw));
+    CHECK(p.sid.bytes == setup.sid.bytes);
+    CHECK(p.sttl == 0x07FFFFFFu);
+    CHECK(p.flags == (FLAG_ACK | FLAG_ACCEPT));
+    CHECK(p.seqnum == 7 && p.acknum == 8 && p.window == 9 && p.fid == 0 && p.fo == 0);
+}
+
+/*──────── dados recebidos ────────*/
+// Com timestamps, um datagrama de dados sem os 8 bytes do prefixo é
+// recusado (e contado) em vez de fazer `tamanho - data_offset` dar a volta.
+static void short_data() {
+    Session sess;
+    sess.establish(setup_at(100, 3000));
+    CHECK(sess.data_offset() == Packet::HDR_SIZE);
+    CHECK(sess.accept_data_len(Packet::HDR_SIZE + 1));
+    sess.set_timestamps(true);
+    CHECK(sess.data_offset() == Packet::HDR_SIZE + Timestamps::LEN);
+    CHECK(!sess.accept_data_len(Packet::HDR_SIZE + 1));
+    CHECK(!sess.accept_data_len(Packet::HDR_SIZE + Timestamps::LEN - 1));
+    CHECK(sess.accept_data_len(Packet::HDR_SIZE + Timestamps::LEN));
+    CHECK(sess.stats().rx_malformed == 2);
+}
+
+/*──────── janela remota pequena e persist timer ────────*/
+// Janela anunciada menor que um fragmento: os fragmentos seguem a janela e o
+// primeiro sai (antes, um fragmento de 1440 B nunca cabia e a sessão travava).
+static void small_window() {
+    Session sess;
+    sess.establish(setup_at(100, 1000));
+    sess.queue_data(std::vector<uint8_t>(3000, 'x'));
+    CHECK(sess.peek_next_seq() == 104);                       // 3 fragmentos de 1000 B.
+    std::vector<size_t> ready;
+    sess.ready_to_send(800, ready);
+    CHECK(ready.size() == 1 && sess.tx_seq(ready[0]) == 101);
+    for (size_t s : ready) { sess.prepare_tx(s); sess.mark_sent(s); }
+    sess.handle_ack(101, 1000, 5000);
+    sess.ready_to_send(800, ready);
+    CHECK(ready.size() == 1 && sess.tx_seq(ready[0]) == 102);
+}
+
+// Janela minúscula com mensagem de vários KB: fragmentar pela janela
+// passaria de 256 fragmentos (o fo daria a volta), então o tamanho cheio é
+// mantido e os fo seguem distintos.
+static void tiny_window() {
+    Session sess;
+    sess.establish(setup_at(100, 64));
+    sess.queue_data(std::vector<uint8_t>(20000, 'x'));
+    CHECK(sess.peek_next_seq() == 101 + (20000 + Payload::CAPACITY - 1) / Payload::CAPACITY);
+    // 64 B ainda bastam para 256 fragmentos de uma mensagem menor.
+    Session small;
+    small.establish(setup_at(100, 64));
+    small.queue_data(std::vector<uint8_t>(256 * 64, 'x'));
+    CHECK(small.peek_next_seq() == 101 + 256);
+    small.queue_data(std::vector<uint8_t>(256 * 64 + 1, 'x'));
+    CHECK(small.peek_next_seq() == 101 + 256 + 12);
+}
+
+// Janela zero: as respostas às sondas (ACKs com janela zero) não desarmam o
+// backoff, que dobra a cada sonda até o teto.
+static void persist_backoff() {
+    using namespace std::chrono;
+    Session sess;
+    sess.establish(setup_at(100, 0));
+    sess.queue_data(std::vector<uint8_t>(500, 'x'));
+    auto t = steady_clock::now();
+    CHECK(!sess.persist_probe_due(10, t));                    // Arma: primeira sonda em 10 ms.
+    int expected = 10;
+    for (int i = 0; i < 12; ++i) {
+        t += milliseconds(expected);
+        CHECK(sess.persist_probe_due(10, t));
+        expected = std::min(expected * 2, 8000);
+        sess.handle_ack(100, 0, 5000);                        // Resposta à sonda: janela ainda zero.
+        CHECK(sess.persist_wait_ms(t) == expected);
+    }
+    CHECK(expected == 8000);
+    sess.handle_ack(100, 2000, 5000);                         // A janela abriu: desarma.
+    CHECK(!sess.persist_probe_due(10, t));
+    CHECK(sess.persist_wait_ms(t) == -1);
+}
+
+int main() {
+    rx_tracker_wrap();
+    session_wrap();
+    header_template();
+    short_data();
+    small_window();
+    tiny_window();
+    persist_backoff();
+    if (failures) { std::cerr << failures << " verificação(ões) falharam\n"; return 1; }
+    std::cout << "slowcheck: OK\n";
+    return 0;
+}
@@ -0,0 +1,57 @@
+//
+//  slowtrace.cpp – decodificador do registro binário de pacotes do SLOW
+//
+
+// Este arquivo implementa o utilitário offline que lê um arquivo gravado
+// com `slowclient --trace` e o imprime no mesmo formato legível que o
+// cliente usava (cabeçalho de cada pacote e prévia do payload).
+// Com `-t`, cada pacote também mostra o instante relativo ao início do log.
+
+#include "trace_log.hpp"  // Inclui TraceRecord e os nomes dos rótulos.
+#include <algorithm>      // Para std::clamp e std::min.
+#include <cstring>        // Para std::memcmp e std::strcmp.
+#include <iomanip>        // Para formatação do instante.
+#include <iostream>       // Para entrada/saída padrão.
+
+using namespace slow;
+
+int main(int argc, char* argv[]) {
+    bool        times = false;
+    const char* path  = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "-t") == 0) times = true;
+        else                                 path  = argv[i];
+    }
+    if (!path) { std::cerr << "uso: ./slowtrace [-t] ARQUIVO\n"; return 1; }
+
+    std::FILE* f = std::fopen(path, "rb");
+    if (!f) { std::perror(path); return 1; }
+    char magic[sizeof(TRACE_MAGIC)];
+    if (std::fread(magic, 1, sizeof(magic), f) != sizeof(magic) ||
+        std::memcmp(magic, TRACE_MAGIC, sizeof(magic)) != 0) {
+        std::cerr << path << ": não é um registro do SLOW\n";
+        return 1;
+    }
+
+    TraceRecord r;
+    uint8_t     raw[Packet::HDR_SIZE + Payload::CAPACITY];
+    while (std::fread(&r, sizeof(r), 1, f) == 1) {
+        // Só a prévia do payload foi gravada: o restante é completado com zeros
+        // para que o pretty-print mostre o tamanho real (e as reticências).
+        size_t len = std::clamp<size_t>(r.len, Packet::HDR_SIZE, sizeof(raw));
+        size_t pre = std::min<size_t>({r.preview_len, TraceRecord::PREVIEW, len - Packet::HDR_SIZE});
+        std::memcpy(raw, r.hdr, Packet::HDR_SIZE);
+        std::memcpy(raw + Packet::HDR_SIZE, r.preview, pre);
+        std::memset(raw + Packet::HDR_SIZE + pre, 0, len - Packet::HDR_SIZE - pre);
+        Packet p = Packet::deserialize(raw, len);
+
+        std::cout << "\n" << trace_dir_arrow(r.dir) << " " << trace_tag_name(r.tag)
+                  << " seq=" << p.seqnum << " (" << r.len << "B)";
+        if (times)
+            std::cout << " @" << std::fixed << std::setprecision(3) << r.t_ns / 1e6 << "ms"
+                      << std::defaultfloat;
+        std::cout << "\n" << p;
+    }
+    std::fclose(f);
+    return 0;
+}
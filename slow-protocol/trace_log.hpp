@@ -0,0 +1,162 @@
+#pragma once
+//
+//  trace_log.hpp  –  Registro binário assíncrono dos pacotes do SLOW
+// Este arquivo define o TraceLog: cada pacote enviado ou recebido vira um
+// registro binário de tamanho fixo (TraceRecord) num anel lock-free de um
+// produtor e um consumidor. O laço de I/O só copia 128 bytes para o anel;
+// uma thread de fundo esvazia o anel para o arquivo. O decodificador
+// offline (slowtrace) reproduz a saída legível de dump_packet.
+#include "slow_packet.hpp" // Para Packet::HDR_SIZE.
+#include <algorithm>       // Para std::min.
+#include <array>           // Para o anel de registros.
+#include <atomic>          // Para os índices do anel e o sinal de parada.
+#include <chrono>          // Para os timestamps e a espera da thread.
+#include <cstdint>         // Para tipos inteiros de largura fixa.
+#include <cstdio>          // Para FILE*, fopen e fwrite.
+#include <cstring>         // Para std::memcpy.
+#include <iterator>        // Para std::size.
+#include <memory>          // Para std::unique_ptr do anel.
+#include <thread>          // Para a thread de escrita.
+
+// Nível de trace fixado na compilação (-DSLOW_TRACE_LEVEL=N, ver Makefile):
+//   0 = nada: as chamadas de registro somem do binário (release);
+//   1 = registro binário assíncrono (--trace), o padrão;
+//   2 = também imprime cada pacote por extenso em stdout (debug).
+#ifndef SLOW_TRACE_LEVEL
+#define SLOW_TRACE_LEVEL 1
+#endif
+
+namespace slow {
+
+inline constexpr int TRACE_OFF    = 0;
+inline constexpr int TRACE_BINARY = 1;
+inline constexpr int TRACE_TEXT   = 2;
+inline constexpr int TRACE_LEVEL  = SLOW_TRACE_LEVEL;
+static_assert(TRACE_LEVEL >= TRACE_OFF && TRACE_LEVEL <= TRACE_TEXT, "SLOW_TRACE_LEVEL deve ser 0, 1 ou 2");
+
+// Direção e rótulo de cada registro (os rótulos são os de dump_packet).
+enum class TraceDir : uint8_t { Tx = 0, Rx = 1 };
+enum class TraceTag : uint8_t {
+    Connect, Setup, Data, Retx, Tlp, Revive, Parity, AckPure,
+    Probe, Nack, Disconnect, Rx, FecRec, Count_
+};
+inline const char* trace_tag_name(TraceTag t) {
+    static constexpr const char* names[] = {
+        "CONNECT", "SETUP", "DATA/FRAG", "RETX", "TLP", "REVIVE", "PARITY", "ACK-PURE",
+        "PROBE", "NACK", "DISCONNECT", "RX", "FEC-REC"};
+    static_assert(std::size(names) == static_cast<size_t>(TraceTag::Count_));
+    return t < TraceTag::Count_ ? names[static_cast<size_t>(t)] : "?";
+}
+inline const char* trace_dir_arrow(TraceDir d) { return d == TraceDir::Tx ? "»»" : "««"; }
+
+// Registro de 128 bytes (duas linhas de cache): o cabeçalho cru do datagrama
+// e uma prévia dos primeiros bytes do payload (o que o pretty-print mostra).
+struct TraceRecord {
+    static constexpr size_t PREVIEW = 64;
+
+    uint64_t t_ns;                     // steady_clock desde a abertura do log.
+    uint16_t len;                      // Tamanho do datagrama inteiro.
+    TraceDir dir;
+    TraceTag tag;
+    uint8_t  preview_len;
+    uint8_t  reserved[3];
+    uint8_t  hdr[Packet::HDR_SIZE];    // Cabeçalho exatamente como no fio.
+    uint8_t  preview[PREVIEW];
+    uint8_t  pad[16];
+};
+static_assert(sizeof(TraceRecord) == 128, "TraceRecord deve ter 128 bytes");
+static_assert(std::is_trivially_copyable_v<TraceRecord>);
+
+// O arquivo começa com estes 8 bytes; os registros seguem em ordem, na
+// representação nativa (little-endian) da máquina que gravou.
+constexpr char TRACE_MAGIC[8] = {'S', 'L', 'O', 'W', 'T', 'R', 'C', '1'};
+
+// ───────────────────────── TraceLog ─────────────────────────
+// Anel SPSC: o laço de I/O é o único produtor e a thread de escrita, a única
+// consumidora. Se o anel encher, o registro é descartado (e contado): o
+// laço de I/O nunca espera pelo disco.
+class TraceLog {
+public:
+    static constexpr size_t CAPACITY = 4096; // Potência de 2 (512 KB de registros).
+
+    TraceLog() = default;
+    ~TraceLog() { close(); }
+    TraceLog(const TraceLog&)            = delete;
+    TraceLog& operator=(const TraceLog&) = delete;
+
+    // Abre o arquivo e inicia a thread de escrita. Retorna false se não abriu.
+    bool open(const char* path) {
+        close();
+        f_ = std::fopen(path, "wb");
+        if (!f_) return false;
+        std::fwrite(TRACE_MAGIC, 1, sizeof(TRACE_MAGIC), f_);
+        ring_  = std::make_unique<std::array<TraceRecord, CAPACITY>>();
+        head_.store(0, std::memory_order_relaxed);
+        tail_.store(0, std::memory_order_relaxed);
+        stop_.store(false, std::memory_order_relaxed);
+        t0_    = std::chrono::steady_clock::now();
+        writer_ = std::thread([this] { drain_loop(); });
+        return true;
+    }
+    // Para a thread depois de esvaziar o anel e fecha o arquivo.
+    void close() {
+        if (!f_) return;
+        stop_.store(true, std::memory_order_release);
+        writer_.join();
+        std::fclose(f_);
+        f_ = nullptr;
+    }
+    bool   active()  const { return f_ != nullptr; }
+    size_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+    // Produtor: copia o cabeçalho e a prévia de um datagrama para o anel.
+    void record(TraceDir dir, TraceTag tag, const uint8_t* raw, size_t len) {
+        if (!f_ || len < Packet::HDR_SIZE) return;
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head - tail_.load(std::memory_order_acquire) == CAPACITY) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        TraceRecord& r = (*ring_)[head & (CAPACITY - 1)];
+        r.t_ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                     std::chrono::steady_clock::now() - t0_).count());
+        r.len  = static_cast<uint16_t>(len);
+        r.dir  = dir;
+        r.tag  = tag;
+        r.preview_len = static_cast<uint8_t>(std::min(len - Packet::HDR_SIZE, TraceRecord::PREVIEW));
+        std::memcpy(r.hdr, raw, Packet::HDR_SIZE);
+        std::memcpy(r.preview, raw + Packet::HDR_SIZE, r.preview_len);
+        head_.store(head + 1, std::memory_order_release);
+    }
+
+private:
+    // Consumidor: grava em lotes contíguos do anel; dorme 1 ms quando vazio.
+    void drain_loop() {
+        while (true) {
+            bool   stopping = stop_.load(std::memory_order_acquire);
+            size_t tail = tail_.load(std::memory_order_relaxed);
+            size_t head = head_.load(std::memory_order_acquire);
+            if (head == tail) {
+                if (stopping) break;
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+            size_t first = tail & (CAPACITY - 1);
+            size_t n     = std::min(head - tail, CAPACITY - first);
+            std::fwrite(&(*ring_)[first], sizeof(TraceRecord), n, f_);
+            tail_.store(tail + n, std::memory_order_release);
+        }
+        std::fflush(f_);
+    }
+
+    std::FILE* f_ = nullptr;
+    std::unique_ptr<std::array<TraceRecord, CAPACITY>> ring_;
+    alignas(64) std::atomic<size_t> head_{0};   // Próximo slot do produtor.
+    alignas(64) std::atomic<size_t> tail_{0};   // Próximo slot do consumidor.
+    alignas(64) std::atomic<bool>   stop_{false};
+    std::atomic<size_t> dropped_{0};
+    std::chrono::steady_clock::time_point t0_{};
+    std::thread writer_;
+};
+
+} // namespace slow
@@ -0,0 +1,113 @@
+#pragma once
+//
+//  tx_queue.hpp  –  Fila de transmissão do SLOW em layout SoA
+// Este arquivo define a fila de saída da sessão como um anel de arrays
+// paralelos (structure-of-arrays): seqnum, tamanho, flags e timestamps ficam
+// em vetores densos separados do handle da imagem serializada. As varreduras
+// de ready_to_send/window_remote_left percorrem só os campos que usam.
+#include "buffer_pool.hpp" // Para PacketBuf (imagem serializada de cada pacote).
+#include <chrono>          // Para os timestamps de envio.
+#include <cstdint>         // Para tipos inteiros de largura fixa.
+#include <vector>          // Para os arrays do anel.
+
+namespace slow {
+
+class TxQueue {
+public:
+    using time_point = std::chrono::steady_clock::time_point;
+
+    /*──── tamanho e endereçamento ────*/
+    // As posições lógicas vão de 0 (mais antiga) a size()-1; `slot(i)` converte
+    // para o índice físico no anel. Um slot permanece válido até o próximo
+    // push_back (que pode realocar) ou o pop_front que o remove.
+    size_t size()  const { return count_; }
+    bool   empty() const { return count_ == 0; }
+    size_t slot(size_t i) const { return (head_ + i) & mask_; }
+    size_t front() const { return head_; }
+    size_t back()  const { return slot(count_ - 1); }
+
+    /*──── inserção e remoção ────*/
+    void push_back(uint32_t seqnum, uint8_t flags, uint16_t payload_len,
+                   uint8_t fid, uint8_t fo, PacketBuf&& wire) {
+        if (count_ == seq_.size()) grow();
+        size_t s = slot(count_);
+        seq_[s]        = seqnum;
+        size_[s]       = payload_len;
+        flags_[s]      = flags;
+        fid_[s]        = fid;
+        fo_[s]         = fo;
+        first_sent_[s] = time_point{};
+        last_sent_[s]  = time_point{};
+        wire_[s]       = std::move(wire);
+        ++count_;
+    }
+    void pop_front() {
+        wire_[head_].reset(); // Devolve a imagem ao pool imediatamente.
+        head_ = (head_ + 1) & mask_;
+        --count_;
+    }
+
+    /*──── campos quentes (varridos a cada iteração) ────*/
+    uint32_t    seq(size_t s)       const { return seq_[s];  }
+    uint16_t    size_of(size_t s)   const { return size_[s]; }
+    uint8_t     flags(size_t s)     const { return flags_[s]; }
+    time_point  last_sent(size_t s) const { return last_sent_[s]; }
+    bool        sent(size_t s)      const { return last_sent_[s].time_since_epoch().count() != 0; }
+
+    /*──── campos frios ────*/
+    time_point  first_sent(size_t s) const { return first_sent_[s]; }
+    uint8_t     fid(size_t s)        const { return fid_[s]; }
+    uint8_t     fo(size_t s)         const { return fo_[s]; }
+    PacketBuf&  wire(size_t s)             { return wire_[s]; }
+
+    // Registra um envio: first_sent só é preenchido na primeira vez.
+    void mark_sent(size_t s, time_point now) {
+        if (!sent(s)) first_sent_[s] = now;
+        last_sent_[s] = now;
+    }
+    // Força o timeout de um pacote já enviado (ex.: pedido por NACK): o último
+    // envio passa a ser o instante mais antigo representável diferente de zero.
+    void expire(size_t s) {
+        if (sent(s)) last_sent_[s] = time_point(time_point::duration(1));
+    }
+
+private:
+    // Dobra a capacidade (sempre potência de 2), desenrolando o anel em ordem.
+    void grow() {
+        size_t cap = seq_.empty() ? 64 : seq_.size() * 2;
+        std::vector<uint32_t>   seq(cap);
+        std::vector<uint16_t>   size(cap);
+        std::vector<uint8_t>    flags(cap), fid(cap), fo(cap);
+        std::vector<time_point> first(cap), last(cap);
+        std::vector<PacketBuf>  wire(cap);
+        for (size_t i = 0; i < count_; ++i) {
+            size_t s = slot(i);
+            seq[i]   = seq_[s];
+            size[i]  = size_[s];
+            flags[i] = flags_[s];
+            fid[i]   = fid_[s];
+            fo[i]    = fo_[s];
+            first[i] = first_sent_[s];
+            last[i]  = last_sent_[s];
+            wire[i]  = std::move(wire_[s]);
+        }
+        seq_.swap(seq);     size_.swap(size);       flags_.swap(flags);
+        fid_.swap(fid);     fo_.swap(fo);
+        first_sent_.swap(first); last_sent_.swap(last); wire_.swap(wire);
+        head_ = 0;
+        mask_ = cap - 1;
+    }
+
+    std::vector<uint32_t>   seq_;
+    std::vector<uint16_t>   size_;       // Bytes de payload (contam na janela remota).
+    std::vector<uint8_t>    flags_;
+    std::vector<uint8_t>    fid_, fo_;   // Identificação do fragmento (para NACK).
+    std::vector<time_point> first_sent_; // Primeira vez que o pacote foi enviado.
+    std::vector<time_point> last_sent_;  // Última vez que o pacote foi enviado (para RTO).
+    std::vector<PacketBuf>  wire_;       // Handle da imagem serializada no pool.
+    size_t head_  = 0;
+    size_t count_ = 0;
+    size_t mask_  = 0;
+};
+
+} // namespace slow